@@ -0,0 +1,75 @@
+#include "arena.hpp"
+
+#include <cstdint>
+
+using namespace std;
+
+ASTArena::ASTArena(size_t block_size) : mBlockSize(block_size) {}
+
+void* ASTArena::Allocate(size_t size, size_t align) {
+	for (;;) {
+		if (mCursor != nullptr) {
+			uintptr_t p = (reinterpret_cast<uintptr_t>(mCursor) + align - 1) & ~(uintptr_t)(align - 1);
+			char *begin = reinterpret_cast<char*>(p);
+
+			if (begin + size <= mEnd) {
+				mUsed += begin + size - mCursor;
+				mCursor = begin + size;
+				return begin;
+			}
+
+			mBlock++;
+		}
+
+		// move on to the next retained block, or grab a bigger one
+		while (mBlock < mBlocks.size() && mBlocks[mBlock].second < size + align)
+			mBlock++;
+
+		if (mBlock >= mBlocks.size()) {
+			size_t n = mBlocks.empty() ? mBlockSize : mBlocks.back().second * 2;
+			if (n < size + align)
+				n = size + align;
+			mBlocks.push_back(make_pair(static_cast<char*>(::operator new(n)), n));
+			mBlock = mBlocks.size() - 1;
+		}
+
+		mCursor = mBlocks[mBlock].first;
+		mEnd = mCursor + mBlocks[mBlock].second;
+	}
+}
+
+void ASTArena::Reset() {
+	while (mFinalizers != nullptr) {
+		Finalizer *f = mFinalizers;
+		mFinalizers = f->next;
+		f->destroy(f->object);
+	}
+
+	mBlock = 0;
+	mUsed = 0;
+	mObjects = 0;
+	mCursor = mBlocks.empty() ? nullptr : mBlocks[0].first;
+	mEnd = mBlocks.empty() ? nullptr : mCursor + mBlocks[0].second;
+}
+
+size_t ASTArena::GetObjectCount() {
+	return mObjects;
+}
+
+size_t ASTArena::GetBytesUsed() {
+	return mUsed;
+}
+
+size_t ASTArena::GetBytesReserved() {
+	size_t n = 0;
+	for (vector<pair<char*, size_t>>::iterator it = mBlocks.begin(); it != mBlocks.end(); ++it)
+		n += it->second;
+	return n;
+}
+
+ASTArena::~ASTArena() {
+	Reset();
+
+	for (vector<pair<char*, size_t>>::iterator it = mBlocks.begin(); it != mBlocks.end(); ++it)
+		::operator delete(it->first);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Bump allocator that owns every entity of one parse (a line or a directive
+// body). Nodes are never freed one by one: Reset() runs all destructors and
+// rewinds into the blocks already held, so a reused arena stops allocating.
+class ASTArena {
+public:
+	ASTArena(size_t block_size = 4096);
+
+	template<typename T, typename... Args>
+	T* New(Args&&... args) {
+		T *obj = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+		if (!is_trivially_destructible<T>::value) {
+			Finalizer *f = new (Allocate(sizeof(Finalizer), alignof(Finalizer))) Finalizer;
+			f->next = mFinalizers;
+			f->destroy = &Destroy<T>;
+			f->object = obj;
+			mFinalizers = f;
+		}
+
+		mObjects++;
+		return obj;
+	}
+
+	void* Allocate(size_t size, size_t align = alignof(max_align_t));
+	void Reset();
+	size_t GetObjectCount();
+	size_t GetBytesUsed();
+	size_t GetBytesReserved();
+	~ASTArena();
+private:
+	struct Finalizer {
+		Finalizer *next;
+		void (*destroy)(void*);
+		void *object;
+	};
+
+	template<typename T>
+	static void Destroy(void *p) {
+		static_cast<T*>(p)->~T();
+	}
+
+	ASTArena(const ASTArena&) = delete;
+	ASTArena& operator=(const ASTArena&) = delete;
+
+	size_t mBlockSize;
+	vector<pair<char*, size_t>> mBlocks;
+	size_t mBlock = 0, mUsed = 0;
+	char *mCursor = nullptr, *mEnd = nullptr;
+	Finalizer *mFinalizers = nullptr;
+	size_t mObjects = 0;
+};
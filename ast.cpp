@@ -1,32 +1,109 @@
-#include <iostream>
 #include <fstream>
+#include <iostream>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "entities/entities.hpp"
 #include "exceptions.hpp"
 #include "interpreter.hpp"
+#include "number.hpp"
+#include "pipeline.hpp"
+#include "pool.hpp"
+#include "reader.hpp"
+#include "transpiler.hpp"
 
 using namespace std;
 
 // -- MARK: Test suite
-void TestSuite(ASTInterpreter *m, istream *fp, bool verbose=false) {
-	bool unexpected = true;
+
+// Like stod, without the locale.
+static double ParseNumber(const string &s) {
+	double r;
+
+	if (ASTNumber::Scan(s.data(), s.length(), r) == 0)
+		throw ASTException("wrong test suite syntax");
+
+	return r;
+}
+
+struct TestCounts {
 	int ok = 0, miss = 0, error = 0;
-	string input;
-	Entity *tmp;
-	int line = 0;
+};
+
+// Runs one `input,expected` case, reporting to `out`.
+static void TestCase(ASTInterpreter *m, string input, int line, ostream &out, TestCounts &counts, bool verbose) {
+	bool unexpected = true;
+	Entity *tmp = nullptr;
 
-	while (fp->good())
 	try {
 		double r = NAN, o;
 		bool nan;
-		string now;
 		string output;
 		size_t p;
 
-		tmp = nullptr;
-		unexpected = true;
+		p = input.find(',');
+		if (p == string::npos || p == input.length()-1) {
+			throw ASTException("wrong test suite syntax");
+		} else {
+			output = input.substr(p+1, string::npos);
+			input = input.substr(0, p);
+		}
+
+		if (output == "ERROR") {
+			unexpected = false;
+		}
+
+		m->Run(input, &tmp);
+
+		if (!m->IsStackEmpty())
+			r = m->PopFromStack();
+
+		if (!output.empty() && output != "ERROR" && output != "IGNORE" && (((nan = isnan(o = ParseNumber(output))) && isnan(r)) || (!nan && (r == o || to_string(r) == to_string(o))))) {
+			if (verbose)
+				out << "OK  [" << input << "] => ops[" << m->GetPostfix(tmp) << "] (return " << r << ") on line " << line << endl;
+			counts.ok++;
+		} else if (output != "IGNORE") {
+			out << "MIS [" << input << "] => ops[" << m->GetPostfix(tmp) << "] (gets " << output << ",  return " << r << ") on line " << line << endl;
+			counts.miss++;
+		} else {
+			counts.ok++;
+		}
+	} catch(const ASTException &ex) {
+		//cout << "ERR " << ex.what() << endl;
+		if (unexpected) {
+			out << "ERR [" << input << "] => err[" << ex.what() << "] on line " << line << endl; 
+			counts.error++;
+		} else {
+			if (verbose)
+				out << "OK  [" << input << "] => err[" << ex.what() << "] on line " << line << endl; 
+			counts.ok++;
+		}
+	}
+}
+
+static void PrintCounts(const TestCounts &counts) {
+	cout << "COUNT---" << endl;
+	cout << "OK: " << counts.ok << endl;
+	cout << "MIS: " << counts.miss << endl;
+	cout << "ERR: " << counts.error << endl;
+}
+
+void TestSuite(ASTInterpreter *m, istream *fp, bool verbose=false) {
+	TestCounts counts;
+	string input;
+	int line = 0;
+
+	while (fp->good()) {
+		string now;
 
 		if (fp == &cin)
 			cout << (input.empty() ? "> " : "  ");
@@ -34,7 +111,6 @@ void TestSuite(ASTInterpreter *m, istream *fp, bool verbose=false) {
 			line++;
 
 		getline(*fp, now, '\n');
-		//getline(fp, output, '\n');
 
 		if (!fp->good() && now.empty()) {
 			if (fp == &cin)
@@ -49,62 +125,200 @@ void TestSuite(ASTInterpreter *m, istream *fp, bool verbose=false) {
 			input += now;
 		}
 
-		p = input.find(',');
-		if (p == string::npos || p == now.length()-1) {
-			throw ASTException("wrong test suite syntax");
-		} else {
-			output = input.substr(p+1, string::npos);
-			input = input.substr(0, p);
-		}
+		TestCase(m, input, line, cout, counts, verbose);
+		input.clear();
+	}
 
-		if (output == "ERROR") {
-			unexpected = false;
+	PrintCounts(counts);
+}
+
+// -- MARK: Sharded test suite
+
+typedef chrono::steady_clock Clock;
+
+// Test files are cut into shards at this line, each shard starting over on
+// a fresh interpreter.
+static const char *sResetMarker = "#reset";
+
+// Consecutive lines of one test file, run on their own interpreter.
+struct TestShard {
+	size_t file;
+	// the line number of `lines[0]`, less one
+	int first;
+	vector<string> lines;
+
+	// filled in by the worker
+	string output;
+	TestCounts counts;
+	double seconds = 0;
+	// the last line of every case, with its wall time
+	vector<pair<int, double>> times;
+};
+
+struct TestTime {
+	size_t file;
+	int line;
+	double seconds;
+};
+
+// Cuts `reader` into shards at every reset marker.
+static void ShardTestFile(size_t file, ASTLineReader &reader, vector<TestShard> &shards) {
+	const size_t marker = strlen(sResetMarker);
+	const char *now;
+	size_t length;
+
+	shards.push_back(TestShard());
+	shards.back().file = file;
+	shards.back().first = 0;
+
+	while (reader.ReadLine(now, length)) {
+		if (length == marker && memcmp(now, sResetMarker, marker) == 0) {
+			shards.push_back(TestShard());
+			shards.back().file = file;
+			shards.back().first = reader.GetLine();
+		} else {
+			shards.back().lines.push_back(string(now, length));
 		}
+	}
+}
 
-		m->Run(input, &tmp);
+static void RunTestShard(TestShard &shard, ASTInterpreter *m, ostream &out, bool verbose) {
+	Clock::time_point begin = Clock::now();
+	string input;
+	int line = shard.first;
 
-		if (!m->IsStackEmpty())
-			r = m->PopFromStack();
+	for (const string &now : shard.lines) {
+		line++;
 
-		if (!output.empty() && output != "ERROR" && output != "IGNORE" && (((nan = isnan(o = stod(output))) && isnan(r)) || (!nan && (r == o || to_string(r) == to_string(o))))) {
-			if (verbose)
-				cout << "OK  [" << input << "] => ops[" << m->GetPostfix(tmp) << "] (return " << r << ") on line " << line << endl;
-			ok++;
-		} else if (output != "IGNORE") {
-			cout << "MIS [" << input << "] => ops[" << m->GetPostfix(tmp) << "] (gets " << output << ",  return " << r << ") on line " << line << endl;
-			miss++;
+		if (now.find('\\') == now.length() - 1) {
+			input += now.substr(0, now.length() - 1);
+			continue;
 		} else {
-			ok++;
+			input += now;
 		}
 
-		delete tmp;
-		input.clear();
-	} catch(const ASTException &ex) {
-		//cout << "ERR " << ex.what() << endl;
-		if (unexpected) {
-			cout << "ERR [" << input << "] => err[" << ex.what() << "] on line " << line << endl; 
-			if (tmp != nullptr)
-				delete tmp;
-			error++;
-		} else {
-			if (verbose)
-				cout << "OK  [" << input << "] => err[" << ex.what() << "] on line " << line << endl; 
-			if (tmp != nullptr)
-				delete tmp;
-			ok++;
-		}
+		Clock::time_point start = Clock::now();
+		TestCase(m, input, line, out, shard.counts, verbose);
+		shard.times.push_back({line, chrono::duration<double>(Clock::now() - start).count()});
 		input.clear();
 	}
 
-	cout << "COUNT---" << endl;
-	cout << "OK: " << ok << endl;
-	cout << "MIS: " << miss << endl;
-	cout << "ERR: " << error << endl;
+	shard.seconds = chrono::duration<double>(Clock::now() - begin).count();
 }
 
+// Runs every file, shard by shard on a pool of `jobs` threads, and reports
+// in file order whatever the order the shards finished in. The profiles of
+// the shards add up in `profile`.
+void TestFiles(const vector<string> &files, const function<void(ASTInterpreter&)> &configure,
+			   size_t jobs, size_t slowest, bool verbose, ASTProfiler *profile=nullptr) {
+	vector<TestShard> shards;
+	vector<TestTime> times;
+	TestCounts total;
+
+	for (size_t f = 0; f < files.size(); f++) {
+		ASTLineReader src;
+
+		if (!src.Open(files[f])) {
+			cout << "Cannot open file " << files[f] << endl;
+			return;
+		}
+
+		ShardTestFile(f, src, shards);
+	}
+
+	Clock::time_point begin = Clock::now();
+
+	// the interpreters print their traces to cout as they go, so the shards
+	// run one at a time and report there too, each case after its trace
+	if (verbose)
+		jobs = 1;
+
+	// every shard starts over on an interpreter of its own
+	ASTPool pool(jobs);
+	mutex merging;
+	pool.Run(shards.size(), [&](size_t i) {
+		ASTInterpreter m;
+		ostringstream buffer;
+		ostream &out = verbose ? cout : buffer;
+
+		configure(m);
+		RunTestShard(shards[i], &m, out, verbose);
+		shards[i].output = buffer.str();
+
+		if (profile != nullptr && m.GetProfiler() != nullptr) {
+			lock_guard<mutex> lock(merging);
+			profile->Merge(*m.GetProfiler());
+		}
+	});
+
+	double wall = chrono::duration<double>(Clock::now() - begin).count();
+
+	for (size_t f = 0, s = 0; f < files.size(); f++) {
+		const size_t first = s;
+		TestCounts counts;
+		double seconds = 0;
+
+		for (; s < shards.size() && shards[s].file == f; s++) {
+			counts.ok += shards[s].counts.ok;
+			counts.miss += shards[s].counts.miss;
+			counts.error += shards[s].counts.error;
+			seconds += shards[s].seconds;
+
+			for (const pair<int, double> &t : shards[s].times)
+				times.push_back({f, t.first, t.second});
+		}
+
+		cout << "FILE " << files[f] << ": OK " << counts.ok << ", MIS " << counts.miss << ", ERR " << counts.error
+			 << " in " << seconds * 1e3 << " ms" << endl;
+
+		for (size_t i = first; i < s; i++)
+			cout << shards[i].output;
+
+		total.ok += counts.ok;
+		total.miss += counts.miss;
+		total.error += counts.error;
+	}
+
+	cout << "TIME--- " << wall * 1e3 << " ms, " << shards.size() << " shard(s) on " << pool.GetLength() << " thread(s)" << endl;
+
+	slowest = min(slowest, times.size());
+	// ties keep file order, so the report only depends on the timings
+	stable_sort(times.begin(), times.end(), [](const TestTime &a, const TestTime &b) { return a.seconds > b.seconds; });
+	for (size_t i = 0; i < slowest; i++)
+		cout << "SLOW " << times[i].seconds * 1e6 << " us " << files[times[i].file] << ":" << times[i].line << endl;
+
+	PrintCounts(total);
+}
 
 // -- MARK: REPL
 
+static void PrintResult(ASTInterpreter *m, Entity *tmp, bool verbose) {
+	double r;
+
+	if (verbose) {
+		cout << "=> [" << (tmp == nullptr ? "INVALID_ENTITY" : tmp->GetTypeString()) << " " << m->GetPostfix(tmp) << "] " << endl;
+	}
+
+	if (!m->IsStackEmpty()) {
+		do {
+			r = m->PopFromStack();
+
+			if (verbose) {
+				cout << "   ";
+
+				if (r == 0 && tmp == nullptr)
+					cout << "[NULL]";
+				else
+					cout << r << endl;
+			} else {
+				cout << r << endl;
+			}
+		} while(!m->IsStackEmpty());
+	} else if (tmp == nullptr && verbose) {
+		cout << "[NULL]" << endl;
+	}
+}
+
 void REPL(ASTInterpreter *m, istream *fp, bool verbose=false) {
 	string input;
 	int line = 0;
@@ -112,7 +326,6 @@ void REPL(ASTInterpreter *m, istream *fp, bool verbose=false) {
 	while (fp->good())
 	try {
 		Entity *tmp;
-		double r;
 		string now;
 
 		if (fp == &cin)
@@ -138,38 +351,91 @@ void REPL(ASTInterpreter *m, istream *fp, bool verbose=false) {
 		m->Run(input, &tmp);
 		input.clear();
 
-		if (verbose) {
-			cout << "=> [" << (tmp == nullptr ? "INVALID_ENTITY" : tmp->GetTypeString()) << " " << m->GetPostfix(tmp) << "] " << endl;
-		}
+		PrintResult(m, tmp, verbose);
+	} catch(const ASTException &ex) {
+		cout << "Error on line " << line << ": " << ex.what() << endl;
+		input.clear();
 
-		if (!m->IsStackEmpty()) {
-			do {
-				r = m->PopFromStack();
+		if (fp != &cin) {
+			break;
+		}
+	}
+}
 
-				if (verbose) {
-					cout << "   ";
+// RunScript with the lines parsed on another thread, ahead of running them.
+static void RunPipelined(ASTInterpreter *m, ASTLineReader &reader, bool verbose) {
+	ASTPipeline pipeline(reader, m->GetHashConsing());
+	const ASTIncludeEntry *entry;
+	int line;
 
-					if (r == 0 && tmp == nullptr)
-						cout << "[NULL]";
-					else
-						cout << r << endl;
-				} else {
-					cout << r << endl;
-				}
-			} while(!m->IsStackEmpty());
-		} else if (tmp == nullptr && verbose) {
-			cout << "[NULL]" << endl;
-		}
+	while (pipeline.Next(entry, line))
+	try {
+		Entity *tmp;
 
-		delete tmp;
+		m->RunEntry(*entry, &tmp);
+		PrintResult(m, tmp, verbose);
 	} catch(const ASTException &ex) {
 		cout << "Error on line " << line << ": " << ex.what() << endl;
-		input.clear();
+		break;
+	}
+}
 
-		if (fp != &cin) {
-			break;
+// Runs a script straight from its mapping, stopping at the first error.
+void RunScript(ASTInterpreter *m, ASTLineReader &reader, bool verbose=false, bool pipeline=false) {
+	const char *now;
+	size_t length;
+
+	// verbose output counts the nodes a line was parsed into, only known
+	// to the parser thread when hash consing
+	if (pipeline && !(verbose && m->GetHashConsing())) {
+		RunPipelined(m, reader, verbose);
+		return;
+	}
+
+	while (reader.Next(now, length))
+	try {
+		Entity *tmp;
+
+		m->Run(now, length, &tmp);
+		PrintResult(m, tmp, verbose);
+	} catch(const ASTException &ex) {
+		cout << "Error on line " << reader.GetLine() << ": " << ex.what() << endl;
+		break;
+	}
+}
+
+// -- MARK: C++ output
+
+// Writes the program ast_yet would run on `files` as C++: the last one as a
+// script, or all of them as test files.
+static int EmitCpp(const vector<string> &files, bool test, bool optimize, bool hash_consing, const string &output) {
+	ASTTranspiler t;
+	ofstream file;
+
+	t.SetOptimize(optimize);
+	t.SetHashConsing(hash_consing);
+
+	for (size_t i = test ? 0 : files.size() - 1; i < files.size(); i++) {
+		if (!(test ? t.AddTests(files[i]) : t.AddScript(files[i]))) {
+			cout << "Cannot open file " << files[i] << endl;
+			return 1;
 		}
 	}
+
+	if (output.empty()) {
+		t.Write(cout);
+		return 0;
+	}
+
+	file.open(output);
+	if (file)
+		t.Write(file);
+	if (!file) {
+		cout << "Cannot write file " << output << endl;
+		return 1;
+	}
+
+	return 0;
 }
 
 // -- MARK: main
@@ -179,8 +445,20 @@ int main(int argc, char **argv) {
 
 	bool verbose = false;
 	bool test = false;
+	bool optimize = true;
+	bool hash_consing = false;
+	bool memoize = true;
+	bool pipeline = false;
+	bool emit = false;
+
+	size_t jobs = 0, slowest = 10;
+	unsigned jit = 0;
+	shared_ptr<ASTTraceSink> trace;
+	bool profile = false;
+	string stacks;
+	string output;
 
-	string filename;
+	vector<string> filenames;
 
 	for (int i=1; i<argc; i++) {
 		string opt(argv[i]);
@@ -190,14 +468,42 @@ int main(int argc, char **argv) {
 					verbose = true;
 				} else if (opt == "-test") {
 					test = true;
+				} else if (opt == "-no-optimize") {
+					optimize = false;
+				} else if (opt == "-hash-cons") {
+					hash_consing = true;
+				} else if (opt == "-no-memo") {
+					memoize = false;
+				} else if (opt == "-pipeline") {
+					pipeline = true;
+				} else if ((opt == "-jobs" || opt == "-slowest") && i < argc-1) {
+					(opt == "-jobs" ? jobs : slowest) = strtoul(argv[++i], nullptr, 10);
+				} else if (opt == "-jit" && i < argc-1) {
+					jit = strtoul(argv[++i], nullptr, 10);
+				} else if (opt == "-emit-cpp") {
+					emit = true;
+				} else if (opt == "-output" && i < argc-1) {
+					output = argv[++i];
+				} else if (opt == "-profile") {
+					profile = true;
+				} else if (opt == "-profile-stacks" && i < argc-1) {
+					profile = true;
+					stacks = argv[++i];
+				} else if (opt == "-trace" && i < argc-1) {
+					trace = make_shared<ASTTraceSink>();
+					if (!trace->Open(argv[++i])) {
+						cout << "Cannot open file " << argv[i] << endl;
+						return 0;
+					}
 				} else if (opt.length() == 1 && i == argc-1) {
 					break;
 				} else {
 					cout << "Invalid option: " << opt << endl;
 					return 0;
 				}
-			} else if (i == argc-1) {
-				filename = opt;
+			} else if (i == argc-1 || test) {
+				// a test run takes any number of files
+				filenames.push_back(opt);
 			} else {
 				cout << "Invalid option: " << opt << endl;
 				return 0;
@@ -205,31 +511,60 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	m.SetVerbose(verbose);
+	if (emit) {
+		if (filenames.empty()) {
+			cout << "Missing script to emit" << endl;
+			return 1;
+		}
+
+		return EmitCpp(filenames, test, optimize, hash_consing, output);
+	}
 
-	ifstream src;
-	istream *in;
+	auto configure = [&](ASTInterpreter &i) {
+		i.SetVerbose(verbose);
+		i.SetOptimize(optimize);
+		i.SetHashConsing(hash_consing);
+		i.SetMemoize(memoize);
+		i.SetJitThreshold(jit);
+		i.SetTraceSink(trace);
+		i.SetProfiling(profile);
+	};
+
+	auto report = [&](ASTProfiler *p) {
+		if (p == nullptr)
+			return;
+
+		p->Print(cout);
+		if (!stacks.empty() && !p->WriteStacks(stacks))
+			cout << "Cannot write file " << stacks << endl;
+	};
+
+	configure(m);
+
+	if (test && !filenames.empty()) {
+		ASTProfiler merged;
+
+		TestFiles(filenames, configure, jobs, slowest, verbose, profile ? &merged : nullptr);
+		report(profile ? &merged : nullptr);
+		return 0;
+	}
 
-	if (!filename.empty()) {
-		src.open(filename);
+	if (!filenames.empty()) {
+		ASTLineReader src;
 
-		if (!src.is_open()) {
-			cout << "Cannot open file " << filename << endl;
+		if (!src.Open(filenames.back())) {
+			cout << "Cannot open file " << filenames.back() << endl;
 			return 0;
 		}
 
-		in = &src;
-	} else {
-		in = &cin;
-	}
-
-	if (test) {
-		TestSuite(&m, in, verbose);
+		RunScript(&m, src, verbose, pipeline);
+	} else if (test) {
+		TestSuite(&m, &cin, verbose);
 	} else {
-		REPL(&m, in, verbose);
+		REPL(&m, &cin, verbose);
 	}
 
-	src.close();
+	report(m.GetProfiler());
 
 	return 0;
 }
\ No newline at end of file
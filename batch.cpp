@@ -0,0 +1,135 @@
+#include "batch.hpp"
+
+#include <cstring>
+
+using namespace std;
+
+ASTBatch::ASTBatch(ASTInterpreter &m) : mInterpreter(m), mTarget(ASTKernels::GetBestTarget()) {}
+
+void ASTBatch::Compile(Entity *e) {
+	mArena.Reset();
+	mCompiler.Compile(mInterpreter.GetOptimize() ? mOptimizer.Optimize(e, mArena) : e, mProgram,
+		mInterpreter.GetHashConsing(), &mInterpreter);
+
+	if (mProgram.effects.stores)
+		throw ASTInvalidOperation("cannot batch an assignment");
+	else if (mProgram.effects.pops > 0 || mProgram.effects.reads_stack_size)
+		throw ASTInvalidOperation("cannot batch the stack");
+}
+
+void ASTBatch::Bind(const string &symbol, const double *column) {
+	unsigned id = ASTNameTable::Intern(symbol);
+
+	if (id >= mBindings.size())
+		mBindings.resize(ASTNameTable::GetLength(), nullptr);
+
+	mBindings[id] = column;
+}
+
+void ASTBatch::ClearBindings() {
+	mBindings.clear();
+}
+
+void ASTBatch::SetTarget(ASTKernels::Target target) {
+	mTarget = ASTKernels::IsSupported(target) ? target : ASTKernels::SCALAR_TARGET;
+}
+
+ASTKernels::Target ASTBatch::GetTarget() {
+	return mTarget;
+}
+
+void ASTBatch::Run(size_t n, double *out) {
+	for (size_t row = 0; row < n; row += BLOCK_SIZE) {
+		const size_t count = n - row < BLOCK_SIZE ? n - row : BLOCK_SIZE;
+
+		mBlocks.clear();
+		Execute(mProgram, 0, 0, row, count);
+		memcpy(out + row, GetBlock(0), count * sizeof(double));
+	}
+}
+
+// -- MARK: Execution
+
+double* ASTBatch::GetBlock(size_t i) {
+	return mBlocks.data() + i * BLOCK_SIZE;
+}
+
+void ASTBatch::Execute(const ASTProgram &p, size_t args, unsigned argc, size_t row, size_t count) {
+	// blocks, not pointers, as calls grow the storage
+	const size_t base = mBlocks.size() / BLOCK_SIZE, locals = base + p.depth;
+	size_t sp = base, arg = args;
+
+	mBlocks.resize((locals + p.locals) * BLOCK_SIZE);
+
+	for (const ASTInstruction &i : p.code) {
+		switch (i.op) {
+		case ASTInstruction::PUSH_LITERAL:
+			ASTKernels::Fill(GetBlock(sp++), i.value, count);
+			break;
+		case ASTInstruction::LOAD_SYMBOL: {
+			double *b = GetBlock(sp++);
+
+			if (i.name == ASTNameTable::STACK_TOP_NAME) {
+				// the arguments of a directive, first one first
+				if (arg >= args + argc)
+					throw ASTInvalidOperation("stack is empty");
+				memcpy(b, GetBlock(arg++), count * sizeof(double));
+				if (i.negative)
+					ASTKernels::Negate(b, count);
+			} else if (i.name < mBindings.size() && mBindings[i.name] != nullptr) {
+				memcpy(b, mBindings[i.name] + row, count * sizeof(double));
+				if (i.negative)
+					ASTKernels::Negate(b, count);
+			} else {
+				ASTKernels::Fill(b, mInterpreter.GetSymbol(i.name, i.negative), count);
+			}
+			break;
+		}
+		case ASTInstruction::ARITHMETIC_ADD:
+		case ASTInstruction::ARITHMETIC_SUB:
+		case ASTInstruction::ARITHMETIC_MUL:
+		case ASTInstruction::ARITHMETIC_DIV:
+		case ASTInstruction::ARITHMETIC_MOD:
+		case ASTInstruction::ARITHMETIC_POW:
+			sp--;
+			ASTKernels::Get(i.op, mTarget)(GetBlock(sp - 1), GetBlock(sp), count);
+			break;
+		case ASTInstruction::NEGATE:
+			ASTKernels::Negate(GetBlock(sp - 1), count);
+			break;
+		case ASTInstruction::CALL_DIRECTIVE: {
+			if (!mInterpreter.IsPureCall(i.name, i.argc))
+				throw ASTInvalidOperation("cannot batch directive " + ASTNameTable::GetName(i.name));
+
+			const size_t top = sp - i.argc, callee = mBlocks.size() / BLOCK_SIZE;
+
+			Execute(mInterpreter.GetDirective(i.name)->program, top, i.argc, row, count);
+
+			memcpy(GetBlock(top), GetBlock(callee), count * sizeof(double));
+			mBlocks.resize(callee * BLOCK_SIZE);
+			if (i.negative)
+				ASTKernels::Negate(GetBlock(top), count);
+			sp = top + 1;
+			break;
+		}
+		case ASTInstruction::STORE_LOCAL:
+			memcpy(GetBlock(locals + i.name), GetBlock(sp - 1), count * sizeof(double));
+			break;
+		case ASTInstruction::LOAD_LOCAL:
+			memcpy(GetBlock(sp++), GetBlock(locals + i.name), count * sizeof(double));
+			break;
+		case ASTInstruction::RETURN_VALUE:
+			// the result stays in the frame's first block
+			break;
+		case ASTInstruction::RAISE_VALUE_ERROR:
+			throw ASTValueError(p.names[i.name]);
+		case ASTInstruction::RAISE_TYPE_ERROR:
+			throw ASTTypeError(p.names[i.name]);
+		case ASTInstruction::STORE_SYMBOL:
+			throw ASTInvalidOperation("cannot batch an assignment");
+		case ASTInstruction::RAISE_INVALID_OPERATION:
+		default:
+			throw ASTInvalidOperation(p.names[i.name]);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "arena.hpp"
+#include "compiler.hpp"
+#include "interpreter.hpp"
+#include "kernels.hpp"
+#include "optimizer.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Evaluates one parsed expression over many rows at once. Row `i` gives
+// the bits Run would give after setting every bound symbol to its column's
+// `i`th value; unbound symbols read the interpreter. Values flow through
+// blocks of BLOCK_SIZE rows, so each instruction runs once per block.
+//
+// Nothing in the expression may change the interpreter: assignments, `_`,
+// `__` and calls of impure directives (see IsPureCall) raise an
+// ASTInvalidOperation. Pure directives run their bodies a block at a time,
+// their `_` taking the argument columns in order.
+class ASTBatch {
+public:
+	static const size_t BLOCK_SIZE = 512;
+
+	ASTBatch(ASTInterpreter &m);
+	// Compiles `e`, which may be freed afterwards.
+	void Compile(Entity *e);
+	// `column` must hold as many rows as every later Run.
+	void Bind(const string &symbol, const double *column);
+	void ClearBindings();
+	// Defaults to ASTKernels::GetBestTarget().
+	void SetTarget(ASTKernels::Target target);
+	ASTKernels::Target GetTarget();
+	void Run(size_t n, double *out);
+protected:
+	ASTInterpreter &mInterpreter;
+	ASTArena mArena;
+	ASTOptimizer mOptimizer;
+	ASTCompiler mCompiler;
+	ASTProgram mProgram;
+	ASTKernels::Target mTarget;
+	// indexed by interned name, null when unbound
+	vector<const double*> mBindings;
+	// blocks of every program being executed, innermost last
+	vector<double> mBlocks;
+
+	// Runs `p` over `count` rows from `row` into a new frame, whose first
+	// block holds the result; `args` is the block of its first argument.
+	void Execute(const ASTProgram &p, size_t args, unsigned argc, size_t row, size_t count);
+	double* GetBlock(size_t i);
+};
@@ -0,0 +1,1182 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "classifier.hpp"
+#include "entities/entities.hpp"
+#include "exceptions.hpp"
+#include "batch.hpp"
+#include "compiler.hpp"
+#include "interpreter.hpp"
+#include "jit.hpp"
+#include "number.hpp"
+#include "pipeline.hpp"
+#include "pool.hpp"
+#include "reader.hpp"
+#include "tokenizer.hpp"
+
+using namespace std;
+
+// -- MARK: Allocation counting
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// counted from every thread of the threads/ cases
+static atomic<size_t> gAllocations(0);
+
+void* operator new(size_t size) {
+	gAllocations++;
+	if (void *p = malloc(size ? size : 1))
+		return p;
+	throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+// -- MARK: Harness
+
+typedef chrono::steady_clock Clock;
+
+struct BenchCase {
+	string name;
+	// work units (tokens, lines, terms, ...) processed by one call of `body`
+	double units;
+	const char *unit;
+	function<void()> body;
+
+	// filled in by Measure
+	double ns = 0, allocs = 0, rate = 0;
+};
+
+static volatile size_t gSink = 0;
+static vector<BenchCase> gCases;
+
+static void Register(const string &name, double units, const char *unit, function<void()> body) {
+	BenchCase c;
+	c.name = name;
+	c.units = units;
+	c.unit = unit;
+	c.body = body;
+	gCases.push_back(c);
+}
+
+static void Measure(BenchCase &c, double min_seconds) {
+	size_t iterations = 0, allocations;
+	Clock::time_point begin, now;
+
+	// warm up caches and any reusable buffers before counting
+	c.body();
+
+	allocations = gAllocations;
+	begin = Clock::now();
+
+	do {
+		c.body();
+		iterations++;
+		now = Clock::now();
+	} while (chrono::duration<double>(now - begin).count() < min_seconds);
+
+	double seconds = chrono::duration<double>(now - begin).count();
+	c.ns = seconds * 1e9 / iterations;
+	c.allocs = double(gAllocations - allocations) / iterations;
+	c.rate = c.units * iterations / seconds;
+
+	printf("%-32s %14.1f ns/op %12.1f allocs/op %14.0f %s/s\n", c.name.c_str(), c.ns, c.allocs, c.rate, c.unit);
+}
+
+// One object per measured case, for comparing two commits with a script.
+static bool WriteJSON(const string &path, const vector<const BenchCase*> &cases) {
+	ofstream fp(path);
+
+	if (!fp.is_open())
+		return false;
+
+	fp << "[\n";
+	for (size_t i = 0; i < cases.size(); i++) {
+		const BenchCase &c = *cases[i];
+		char line[512];
+
+		// case names are plain ASCII without quotes or backslashes
+		snprintf(line, sizeof(line),
+				 "  {\"name\": \"%s\", \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"units_per_s\": %.1f, \"unit\": \"%s\"}%s\n",
+				 c.name.c_str(), c.ns, c.allocs, c.rate, c.unit, i + 1 < cases.size() ? "," : "");
+		fp << line;
+	}
+	fp << "]\n";
+
+	return fp.good();
+}
+
+// -- MARK: Inputs
+
+static vector<string> ReadTestLines(const string &path) {
+	vector<string> lines;
+	ifstream fp(path);
+	string now, input;
+
+	while (getline(fp, now)) {
+		if (now.find('\\') == now.length() - 1) {
+			input += now.substr(0, now.length() - 1);
+			continue;
+		}
+
+		input += now;
+		size_t p = input.find(',');
+		if (p != string::npos)
+			lines.push_back(input.substr(0, p));
+		input.clear();
+	}
+
+	return lines;
+}
+
+// `terms` operands joined by a rotating set of operators
+static string SyntheticExpression(size_t terms) {
+	static const char *operands[] = { "1.5", "x", "(y-2)", "3", "-z", "sqrt(4)" };
+	static const char operators[] = { '+', '*', '-', '/', '^', '+', '%' };
+	string s;
+
+	for (size_t i = 0; i < terms; i++) {
+		if (i != 0)
+			s += operators[i % sizeof(operators)];
+		s += operands[i % (sizeof(operands) / sizeof(*operands))];
+	}
+
+	return s;
+}
+
+static string PowerChain(size_t terms) {
+	string s("2");
+	for (size_t i = 1; i < terms; i++)
+		s += "^2";
+	return s;
+}
+
+static string NestedParenthesis(size_t terms) {
+	return string(terms, '(') + "1" + string(terms, ')');
+}
+
+// A complete binary tree of `x` with 2^depth leaves, alternating + and -
+// by level so the value stays small.
+static string BalancedExpression(size_t depth) {
+	string s("x");
+	for (size_t i = 0; i < depth; i++)
+		s = "(" + s + (i % 2 ? "-" : "+") + s + ")";
+	return s;
+}
+
+static string SymbolChain(size_t terms, char op) {
+	string s("x");
+	for (size_t i = 1; i < terms; i++) {
+		s += op;
+		s += 'x';
+	}
+	return s;
+}
+
+// -- MARK: Classifier
+
+// The std::regex patterns ASTInterpreter::Run used before ASTClassifier.
+struct RegexClassifier {
+	regex comment, directive, set, call, include, symbol;
+
+	RegexClassifier() :
+		comment("^\\s*#(.*)$"),
+		directive("^\\s*@(.*)$"),
+		set("^\\[\\s*\\$([A-Za-z_]{1}[A-Za-z0-9_]*)\\$\\s*((.*)\\s*){0,1}\\]\\s*$"),
+		call("^\\[\\s*([A-Za-z_]{1}[A-Za-z0-9_]*)\\s*\\]\\s*$"),
+		include("^\\[!(.+)\\]\\s*$"),
+		symbol("^([A-Za-z_]{1}[A-Za-z0-9_]*)\\s*=\\s*(.*)\\s*$") {}
+
+	// "type:key:value", comparable with Describe()
+	string Classify(const string &s) {
+		smatch m;
+
+		if (regex_match(s, m, directive)) {
+			string dir = m.str(1);
+			if (regex_match(dir, m, set))
+				return "set:" + m.str(1) + ":" + m.str(3);
+			else if (regex_match(dir, m, call))
+				return "call:" + m.str(1) + ":";
+			else if (regex_match(dir, m, symbol))
+				return "symbol:" + m.str(1) + ":" + m.str(2);
+			else if (regex_match(dir, m, include))
+				return "include::" + m.str(1);
+			return "invalid::";
+		} else if (regex_match(s, comment)) {
+			return "comment::";
+		}
+		return "expression::" + s;
+	}
+};
+
+static string Describe(const string &s) {
+	static const char *names[] = { "expression", "comment", "set", "call", "symbol", "include", "include", "invalid" };
+	ASTLine l = ASTClassifier::Classify(s);
+
+	// the patterns see the `!` of include-once as part of the path
+	if (l.type == ASTLine::INCLUDE_ONCE_LINE)
+		return "include::!" + s.substr(l.value, l.value_length);
+
+	if (l.type == ASTLine::COMMENT_LINE || l.type == ASTLine::INVALID_DIRECTIVE_LINE)
+		return string(names[l.type]) + "::";
+	return string(names[l.type]) + ":" + s.substr(l.key, l.key_length) + ":" + s.substr(l.value, l.value_length);
+}
+
+static vector<string> ClassifierLines(const vector<string> &lines) {
+	static const char *extra[] = {
+		"@[$pow$_^_]", "  @[$f$ ]", "@[$f$a] ] \t", "@[ $f$x]", "@[$1f$x]", "@[$f$x", "@[$f$x]y",
+		"@[sqrt]", "@[ sqrt \t] ", "@[sqrt]x", "@[!./a.txt]", "@[!!./a.txt]", "@[!!]", "@[!]", "@[!x]]", "@[ !x]",
+		"@x=1", "@x = 2 ", "@ x=1", "@x", "@x==1", "@_1=4",
+		"#comment", "  # c", "#c\r", "@x=1\r", "\n@x=1", "\v#", "x=1", "", "@", "#",
+	};
+	vector<string> r(lines);
+
+	for (const char *e : extra)
+		r.push_back(e);
+	for (const string &l : lines) {
+		r.push_back("@" + l);
+		r.push_back("@x=" + l);
+		r.push_back("@[$f$" + l + "]");
+	}
+
+	return r;
+}
+
+static void RegisterClassifier(const vector<string> &lines) {
+	Register("classify/regex", lines.size(), "lines", [&lines]() {
+		static RegexClassifier re;
+		for (const string &l : lines)
+			gSink += re.Classify(l).length();
+	});
+
+	Register("classify/table", lines.size(), "lines", [&lines]() {
+		for (const string &l : lines)
+			gSink += ASTClassifier::Classify(l).type;
+	});
+}
+
+// -- MARK: Lexer
+
+static void RegisterLexer(const vector<string> &lines, const string &big) {
+	size_t tokens = 0;
+	for (const string &l : lines)
+		tokens += ASTTokenizer(l).GetLength();
+
+	Register("lexer/test.txt", tokens, "tokens", [&lines]() {
+		for (const string &l : lines)
+			gSink += ASTTokenizer(l).GetLength();
+	});
+
+	Register("lexer/100k_terms", ASTTokenizer(big).GetLength(), "tokens", [&big]() {
+		gSink += ASTTokenizer(big).GetLength();
+	});
+}
+
+// -- MARK: Parser
+
+static void RegisterParser(const vector<string> &lines, const string &big) {
+	size_t tokens = 0;
+	for (const string &l : lines)
+		tokens += ASTTokenizer(l).GetLength();
+
+	Register("parse/test.txt", tokens, "tokens", [&lines]() {
+		static ASTLex lex;
+		for (const string &l : lines) {
+			try {
+				lex.Parse(l);
+			} catch (const ASTException &ex) {
+				gSink++;
+			}
+			lex.GetArena().Reset();
+		}
+	});
+
+	Register("parse/100k_terms", ASTTokenizer(big).GetLength(), "tokens", [&big]() {
+		static ASTLex lex;
+		lex.Parse(big);
+		lex.GetArena().Reset();
+	});
+
+	static const vector<pair<string, string>> lengths = {
+		{ "parse/short", "x*2+1" },
+		{ "parse/long", SyntheticExpression(1000) },
+	};
+
+	for (auto &c : lengths) {
+		const string &line = c.second;
+
+		Register(c.first, ASTTokenizer(line).GetLength(), "tokens", [&line]() {
+			static ASTLex lex;
+			lex.Parse(line);
+			lex.GetArena().Reset();
+		});
+	}
+}
+
+// -- MARK: Interpreter
+
+static void RegisterRun(const vector<string> &lines) {
+	Register("run/test.txt", lines.size(), "lines", [&lines]() {
+		static ASTInterpreter m;
+		for (const string &l : lines) {
+			try {
+				m.Run(l);
+			} catch (const ASTException &ex) {
+				gSink++;
+			}
+			while (!m.IsStackEmpty())
+				m.PopFromStack();
+		}
+	});
+}
+
+// Trees parsed once and resolved each op: optimized, compiled and run.
+static void RegisterResolve() {
+	static const vector<pair<string, string>> cases = {
+		{ "resolve/arithmetic", "3*(2^2)+5*(7^2)-4+(2+(2)^10)-10-1-3^(5-2)/10-1" },
+		{ "resolve/symbols", "x*x+y*y-(x-y)*(x+y)+x/y" },
+		{ "resolve/1k_terms", SyntheticExpression(1000) },
+	};
+
+	for (auto &c : cases) {
+		// both live for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		ASTArena *arena = new ASTArena();
+		Entity *e = m->Parse(c.second, *arena);
+
+		m->SetSymbol("x", 3);
+		m->SetSymbol("y", 4);
+		m->SetSymbol("z", 5);
+		m->SetDirective("sqrt", "_^0.5");
+
+		Register(c.first, 1, "resolves", [m, e]() {
+			m->Resolve(e);
+			gSink += (size_t)m->PopFromStack();
+			// what the optimizer rewrote
+			m->GetArena().Reset();
+		});
+	}
+}
+
+// The recursive tree walker ASTInterpreter::Resolve used before the
+// compiler, reduced to arithmetic: one native frame per level of the tree.
+static double RecursiveResolve(ASTInterpreter *m, Entity *e) {
+	switch (e->GetType()) {
+	case Entity::LITERAL_ENTITY:
+		return ((LiteralEntity*)e)->GetNumber();
+	case Entity::OPERAND_ENTITY:
+		return m->GetSymbol(((OperandEntity*)e)->GetName(), ((OperandEntity*)e)->IsNegative());
+	case Entity::PARENTHESIS_ENTITY: {
+		ParenthesisEntity *pe = (ParenthesisEntity*)e;
+		double v = RecursiveResolve(m, pe->Get());
+		return pe->IsNegative() ? -v : v;
+	}
+	case Entity::COMPOUND_ENTITY: {
+		CompoundEntity *ce = (CompoundEntity*)e;
+		double l = RecursiveResolve(m, ce->Get(CompoundEntity::LEFT_ENTITY));
+		double r = RecursiveResolve(m, ce->Get(CompoundEntity::RIGHT_ENTITY));
+		return ASTCompiler::Apply((ASTInstruction::OpCode)(ASTInstruction::ARITHMETIC_ADD +
+			(ce->GetOperator() - TieredEntity::ARITHMETIC_ADD)), l, r);
+	}
+	default:
+		throw ASTTypeError("cannot resolve entity");
+	}
+}
+
+// Balanced and degenerate trees, resolved by the iterative compiler and
+// machine, by the machine alone and by the recursive walker. Deep enough
+// to show the cost per level, shallow enough for the walker to fit in the
+// native stack; only the iterative paths run the million-level tree.
+static void RegisterShapes() {
+	static const size_t n = 10000;
+	static const vector<pair<string, string>> cases = {
+		{ "shape/balanced_8k", BalancedExpression(13) },
+		{ "shape/left_chain_10k", SymbolChain(n, '+') },
+		{ "shape/pow_chain_10k", SymbolChain(n, '^') },
+		{ "shape/nested_10k", NestedParenthesis(n) },
+		{ "shape/nested_1m", NestedParenthesis(1000000) },
+	};
+
+	for (auto &c : cases) {
+		// all live for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		ASTArena *arena = new ASTArena();
+		Entity *e = m->Parse(c.second, *arena);
+		// so both paths see every node
+		m->SetOptimize(false);
+		m->SetSymbol("x", 1);
+
+		Register(c.first + "/iterative", 1, "resolves", [m, e]() {
+			m->Resolve(e);
+			gSink += (size_t)m->PopFromStack();
+		});
+
+		// the machine alone, on the program compiled once
+		ASTProgram *p = new ASTProgram();
+		ASTCompiler().Compile(e, *p);
+		Register(c.first + "/execute", 1, "resolves", [m, p]() {
+			m->Execute(*p);
+			gSink += (size_t)m->PopFromStack();
+		});
+
+		if (c.first.find("_1m") == string::npos)
+			Register(c.first + "/recursive", 1, "resolves", [m, e]() {
+				gSink += (size_t)RecursiveResolve(m, e);
+			});
+	}
+}
+
+// Assigning and reading back symbols by name and by interned id.
+static void RegisterSymbols() {
+	ASTInterpreter *m = new ASTInterpreter();
+	shared_ptr<vector<string>> names = make_shared<vector<string>>();
+	shared_ptr<vector<unsigned>> ids = make_shared<vector<unsigned>>();
+
+	for (int i = 0; i < 64; i++) {
+		names->push_back("symbol_" + to_string(i));
+		ids->push_back(ASTNameTable::Intern(names->back()));
+		m->SetSymbol(names->back(), i);
+	}
+
+	Register("symbols/set_get", 64, "pairs", [m, names]() {
+		for (const string &n : *names) {
+			m->SetSymbol(n, m->GetSymbol(n) + 1);
+		}
+	});
+	Register("symbols/set_get_id", 64, "pairs", [m, ids]() {
+		for (unsigned id : *ids) {
+			m->SetSymbol(id, m->GetSymbol(id) + 1);
+		}
+	});
+}
+
+static void RegisterPostfix(const vector<string> &lines) {
+	ASTInterpreter *m = new ASTInterpreter();
+	ASTArena *arena = new ASTArena();
+	shared_ptr<vector<Entity*>> trees = make_shared<vector<Entity*>>();
+
+	for (const string &l : lines) {
+		try {
+			trees->push_back(m->Parse(l, *arena));
+		} catch (const ASTException &ex) {
+			// not every test line parses
+		}
+	}
+
+	Register("postfix/test.txt", trees->size(), "lines", [m, trees]() {
+		for (Entity *e : *trees)
+			gSink += m->GetPostfix(e).length();
+	});
+}
+
+// The literal decoders: what ResolveLiteral used, strtod, and ASTNumber.
+static void RegisterNumber() {
+	static const vector<string> literals = {
+		"0", "1", "2.5", "07", "10", "256", "1011.3", "3.14159265358979",
+		"0.000125", "123456789012", "99999999999999999999", "1.3",
+	};
+	const double n = literals.size();
+
+	Register("number/istringstream", n, "literals", []() {
+		for (const string &l : literals) {
+			istringstream i(l);
+			double r;
+			i >> r;
+			gSink += (size_t)r;
+		}
+	});
+	Register("number/strtod", n, "literals", []() {
+		for (const string &l : literals)
+			gSink += (size_t)strtod(l.c_str(), nullptr);
+	});
+	Register("number/decode", n, "literals", []() {
+		for (const string &l : literals) {
+			double r;
+			ASTNumber::Decode(l, r);
+			gSink += (size_t)r;
+		}
+	});
+}
+
+// Directive bodies are parsed once; each op only evaluates them.
+static void RegisterEvaluate() {
+	static const struct {
+		const char *name, *body;
+	} cases[] = {
+		{ "eval/arithmetic", "3*(2^2)+5*(7^2)-4+(2+(2)^10)-10-1-3^(5-2)/10-1" },
+		{ "eval/symbols", "x*x+y*y-(x-y)*(x+y)+x/y" },
+		{ "eval/calls", "pow(-negate(sqrt(4));-negate(pow(-negate(2);sqrt(9))))" },
+	};
+
+	for (auto &c : cases)
+	for (bool optimize : { true, false }) {
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetOptimize(optimize);
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("sqrt", "_^0.5");
+		m->SetDirective("negate", "-_");
+		m->SetDirective("bench", c.body);
+		m->SetSymbol("x", 3);
+		m->SetSymbol("y", 4);
+
+		Register(string(c.name) + (optimize ? "" : "/no_optimize"), 1, "evals", [m]() {
+			m->CallDirective("bench");
+			gSink += (size_t)m->PopFromStack();
+		});
+	}
+
+	// the traced evaluator, writing every event as a JSON line
+	ASTInterpreter *traced = new ASTInterpreter();
+	shared_ptr<ASTTraceSink> sink = make_shared<ASTTraceSink>();
+
+	if (sink->Open("/dev/null")) {
+		traced->SetTraceSink(sink);
+		traced->SetDirective("bench", cases[0].body);
+		Register(string(cases[0].name) + "/trace", 1, "evals", [traced]() {
+			traced->CallDirective("bench");
+			gSink += (size_t)traced->PopFromStack();
+		});
+	}
+
+	// a hot directive reading 64 of a few thousand defined symbols
+	ASTInterpreter *m = new ASTInterpreter();
+	string body;
+
+	for (int i = 0; i < 2000; i++)
+		m->SetSymbol("symbol_" + to_string(i), i);
+	for (int i = 0; i < 64; i++)
+		body += (i ? "+symbol_" : "symbol_") + to_string(i * 31 % 2000);
+
+	m->SetDirective("bench", body);
+	Register("eval/2k_symbols", 64, "loads", [m]() {
+		m->CallDirective("bench");
+		gSink += (size_t)m->PopFromStack();
+	});
+}
+
+// Nested directive calls, dominated by dispatch rather than arithmetic.
+static void RegisterCalls() {
+	string deep("2");
+
+	for (int i = 0; i < 32; i++)
+		deep = "pow(1;" + deep + ")";
+
+	static const vector<pair<string, string>> cases = {
+		{ "call/pow(2;pow(2;3))", "pow(2;pow(2;3))" },
+		{ "call/pow_nested_32", deep },
+	};
+
+	for (auto &c : cases) {
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("bench", c.second);
+
+		Register(c.first, 1, "evals", [m]() {
+			m->CallDirective("bench");
+			gSink += (size_t)m->PopFromStack();
+		});
+	}
+
+	// whole lines in the steady state: parsing, compiling and the call
+	// itself should not touch the heap, whatever the length of the name
+	static const vector<pair<string, string>> lines = {
+		{ "call/line/short_name", "pow(x;2)" },
+		{ "call/line/long_name", "a_rather_long_directive_name(x;2)" },
+		{ "call/line/call_by_name", "@[a_rather_long_directive_name]" },
+	};
+
+	for (auto &l : lines) {
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("a_rather_long_directive_name", "pow(_;_)+1");
+		m->SetSymbol("x", 3);
+
+		const string *line = &l.second;
+		Register(l.first, 1, "lines", [m, line]() {
+			if (m->IsStackEmpty()) {
+				m->PushToStack(2);
+				m->PushToStack(3);
+			}
+			m->Run(*line);
+			gSink += (size_t)m->PopFromStack();
+		});
+	}
+}
+
+// A helper called again and again with a handful of argument values.
+static void RegisterMemo() {
+	for (bool memoize : { true, false }) {
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetMemoize(memoize);
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("sqrt", "_^0.5");
+		m->SetDirective("hyp", "sqrt(pow(_;2)+pow(_;2))");
+		m->SetDirective("bench", "hyp(3;4)+hyp(5;12)+hyp(8;15)+hyp(7;24)");
+
+		Register(string("memo/hyp_x4") + (memoize ? "" : "/no_memo"), 4, "calls", [m]() {
+			m->CallDirective("bench");
+			gSink += (size_t)m->PopFromStack();
+		});
+	}
+}
+
+// Directive bodies in the VM against their machine code, memoization off
+// so every call runs the body: the arithmetic alone, libm behind `^` and
+// `%`, symbol loads, and whole lines of a test.txt-style script calling
+// a leaf directive that is compiled and one that calls it, that is not.
+static void RegisterJit() {
+	static const struct {
+		const char *name, *body;
+		unsigned argc;
+	} cases[] = {
+		{ "jit/arith", "(_+1)*(_-2)/(_+3)-_*4+-_", 5 },
+		{ "jit/pow_mod", "_^2+_%3+_^0.5", 3 },
+		{ "jit/symbols", "a*_+b*_+c-(a-b)*(b-c)", 2 },
+	};
+
+	for (unsigned threshold : { 0, 1 }) {
+		const string suffix = threshold == 0 ? "/vm" : "/native";
+
+		if (threshold != 0 && !ASTJit::IsSupported())
+			continue;
+
+		for (auto &c : cases) {
+			// lives for the whole run
+			ASTInterpreter *m = new ASTInterpreter();
+			m->SetMemoize(false);
+			m->SetJitThreshold(threshold);
+			m->SetSymbol("a", 1.5);
+			m->SetSymbol("b", -2.25);
+			m->SetSymbol("c", 7);
+			m->SetDirective("bench", c.body);
+
+			// resolved once, as a call compiled into a line would be
+			const unsigned argc = c.argc, id = ASTNameTable::Find("bench");
+			ASTCallSite *site = new ASTCallSite();
+			Register(c.name + suffix, 1, "calls", [m, argc, id, site]() {
+				for (unsigned a = 0; a < argc; a++)
+					m->PushToStack(a + 1.5);
+				m->CallDirective(id, false, false, site);
+				gSink += (size_t)m->PopFromStack();
+			});
+		}
+
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetMemoize(false);
+		m->SetJitThreshold(threshold);
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("sqrt", "_^0.5");
+		m->SetDirective("hyp", "sqrt(pow(_;2)+pow(_;2))");
+		m->SetSymbol("x", 3);
+
+		static const vector<string> lines = {
+			"pow(x;2)", "sqrt(x*x+16)", "hyp(x;4)", "pow(2;pow(2;3))", "x^2-sqrt(x+1)*pow(x;3)",
+		};
+
+		Register("jit/lines" + suffix, lines.size(), "lines", [m]() {
+			for (const string &l : lines) {
+				m->Run(l);
+				gSink += (size_t)m->PopFromStack();
+			}
+		});
+	}
+}
+
+// One expression over columns of bindings: a batch per kernel target
+// against setting the symbols and running the line for every row.
+static void RegisterBatch() {
+	static const size_t rows = 100000;
+	static const vector<pair<string, string>> cases = {
+		{ "batch/symbols", "x*x+y*y-(x-y)*(x+y)+x/y" },
+		{ "batch/hyp", "hyp(x;y)" },
+	};
+	static vector<double> xs(rows), ys(rows), out(rows);
+
+	for (size_t i = 0; i < rows; i++) {
+		xs[i] = (double)i / 7;
+		ys[i] = 1 + (double)(i % 1000) / 3;
+	}
+
+	for (auto &c : cases) {
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("sqrt", "_^0.5");
+		m->SetDirective("hyp", "sqrt(pow(_;2)+pow(_;2))");
+
+		for (int t = ASTKernels::SCALAR_TARGET; t <= ASTKernels::AVX2_TARGET; t++) {
+			if (!ASTKernels::IsSupported((ASTKernels::Target)t))
+				continue;
+
+			ASTBatch *b = new ASTBatch(*m);
+			b->SetTarget((ASTKernels::Target)t);
+			b->Bind("x", xs.data());
+			b->Bind("y", ys.data());
+			b->Compile(m->Parse(c.second));
+
+			Register(c.first + "/" + ASTKernels::GetTargetString((ASTKernels::Target)t), rows, "rows", [b]() {
+				b->Run(rows, out.data());
+				gSink += (size_t)out[rows - 1];
+			});
+		}
+
+		const string &line = c.second;
+		Register(c.first + "/per_row", rows / 100, "rows", [m, &line]() {
+			for (size_t i = 0; i < rows / 100; i++) {
+				m->SetSymbol("x", xs[i]);
+				m->SetSymbol("y", ys[i]);
+				m->Run(line);
+				out[i] = m->PopFromStack();
+			}
+		});
+	}
+}
+
+// Independent lines against one shared library, from one thread up to one
+// per hardware thread: lines/s should grow with the threads.
+static void RegisterThreads() {
+	static vector<string> lines;
+	size_t hardware = thread::hardware_concurrency();
+
+	for (int i = 0; i < 4096; i++)
+		lines.push_back("hyp(" + to_string(i % 97) + ";x+" + to_string(i % 89) + ")*(x-" + to_string(i) + ")/sqrt(" + to_string(i) + "+y)");
+
+	ASTInterpreter loader;
+	loader.SetDirective("pow", "_^_");
+	loader.SetDirective("sqrt", "_^0.5");
+	loader.SetDirective("hyp", "sqrt(pow(_;2)+pow(_;2))");
+	loader.SetSymbol("x", 3);
+	loader.SetSymbol("y", 4);
+	shared_ptr<ASTLibrary> library = loader.Share();
+
+	for (size_t n = 1; ; n *= 2) {
+		if (n > hardware && n != 1)
+			n = hardware;
+
+		// lives for the whole run
+		ASTPool *pool = new ASTPool(library, n);
+		Register("threads/" + to_string(n), lines.size(), "lines", [pool]() {
+			pool->Run(lines.size(), [](ASTInterpreter &m, size_t i) {
+				m.Run(lines[i]);
+				gSink += (size_t)m.PopFromStack();
+			});
+		});
+
+		if (n >= hardware)
+			break;
+	}
+}
+
+// Whole lines repeating the same subexpressions, parsed as trees and as
+// DAGs with common subexpressions evaluated once.
+static void RegisterSharing(const string &filter) {
+	string norm("sqrt(pow(x;2)+pow(y;2))"), poly("(x*y+x/y)");
+	static vector<pair<string, string>> cases;
+
+	cases.push_back({ "cse/norm_x8", norm });
+	cases.push_back({ "cse/poly_x8", poly });
+	for (auto &c : cases) {
+		string one = c.second;
+		for (int i = 1; i < 8; i++)
+			c.second += (i % 2 ? "+" : "*") + one;
+	}
+
+	for (auto &c : cases)
+	for (bool hash_consing : { false, true }) {
+		// lives for the whole run
+		ASTInterpreter *m = new ASTInterpreter();
+		m->SetHashConsing(hash_consing);
+		m->SetDirective("pow", "_^_");
+		m->SetDirective("sqrt", "_^0.5");
+		m->SetSymbol("x", 3);
+		m->SetSymbol("y", 4);
+
+		const string &line = c.second;
+		const string name = c.first + (hash_consing ? "/hash_cons" : "");
+
+		// what one line costs in the arena, optimized and compiled
+		if (filter.empty() || name.find(filter) != string::npos) {
+			m->Run(line);
+			m->PopFromStack();
+			printf("%-32s %14zu nodes %12zu bytes\n", (name + "/arena").c_str(),
+				   m->GetArena().GetObjectCount(), m->GetArena().GetBytesUsed());
+		}
+
+		Register(name, 1, "lines", [m, &line]() {
+			m->Run(line);
+			gSink += (size_t)m->PopFromStack();
+		});
+	}
+}
+
+// -- MARK: Reader
+
+// A generated script on disk, removed on exit.
+struct ScriptFile {
+	string path;
+	size_t length = 0;
+
+	~ScriptFile() {
+		if (!path.empty())
+			remove(path.c_str());
+	}
+};
+
+static ScriptFile gScript;
+
+// Reading a large script line by line, against copying it whole and the
+// getline loop it replaces. Writes a 64 MB file, so only when asked for.
+static void RegisterReader(const string &filter) {
+	if (filter.empty() || string("reader/").find(filter) == string::npos)
+		return;
+
+	char path[] = "/tmp/ast_yet_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return;
+	close(fd);
+
+	{
+		ofstream fp(path, ios::binary);
+		size_t n = 0;
+
+		for (size_t i = 0; gScript.length < (64u << 20); i++) {
+			string line = i % 16 == 0 ? "x" + to_string(i) + " = 1 + \\\n2 * " + to_string(n++) + "\n" :
+							"(x + " + to_string(i) + ") * 3 ^ 2 - y / 4\n";
+			fp << line;
+			gScript.length += line.length();
+		}
+	}
+
+	gScript.path = path;
+	const double mb = gScript.length / double(1 << 20);
+
+	Register("reader/memcpy", mb, "MB", []() {
+		static vector<char> from(gScript.length, 'x'), to(gScript.length);
+
+		memcpy(to.data(), from.data(), to.size());
+		gSink = gSink + to.back();
+	});
+	Register("reader/mmap", mb, "MB", []() {
+		ASTLineReader reader;
+		const char *line;
+		size_t length, total = 0;
+
+		reader.Open(gScript.path);
+		while (reader.Next(line, length))
+			total += length;
+		gSink = gSink + total;
+	});
+	Register("reader/getline", mb, "MB", []() {
+		ifstream fp(gScript.path);
+		string now, input;
+		size_t total = 0;
+
+		while (getline(fp, now)) {
+			if (now.find('\\') == now.length() - 1) {
+				input += now.substr(0, now.length() - 1);
+				continue;
+			}
+
+			input += now;
+			total += input.length();
+			input.clear();
+		}
+		gSink = gSink + total;
+	});
+}
+
+static ScriptFile gPipelineScript;
+
+// A whole script run line by line, against the same script parsed ahead on
+// another thread, and the parsing alone, which is what the pipeline can
+// take off the interpreter's thread at best. Writes a file of 200k lines,
+// so only when asked for.
+static void RegisterPipeline(const string &filter) {
+	if (filter.empty() || string("pipeline/").find(filter) == string::npos)
+		return;
+
+	static const size_t n = 200000;
+	char path[] = "/tmp/ast_yet_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return;
+	close(fd);
+
+	{
+		ofstream fp(path, ios::binary);
+
+		fp << "@[$sq$ _^2]\n@[$hyp$ (sq(_)+sq(_))^0.5]\n@x = 3\n@y = 4\n";
+		for (size_t i = 0; i < n; i++) {
+			switch (i % 4) {
+			case 0:
+				fp << "x*" << i % 97 << "+y/(x+" << i % 13 << ".5)-(x-y)^2*" << i % 7 << "\n";
+				break;
+			case 1:
+				fp << "hyp(x;y)+hyp(" << i % 50 << ";" << i % 31 << ")*2\n";
+				break;
+			case 2:
+				fp << "@z = (x+" << i % 11 << ")*(y-" << i % 17 << ")/(" << i % 5 << ".25+x*y)\n";
+				break;
+			default:
+				fp << "(((x+1)*(y+2))-((x+3)*(y+4)))+z*" << i % 23 << "-" << i % 9 << "^2\n";
+				break;
+			}
+		}
+	}
+
+	gPipelineScript.path = path;
+
+	Register("pipeline/parse_only", n, "lines", []() {
+		ASTLex lex;
+		ASTLineReader reader;
+		const char *line;
+		size_t length;
+
+		reader.Open(gPipelineScript.path);
+		while (reader.Next(line, length)) {
+			ASTLine l = ASTClassifier::Classify(line, length);
+			if (l.type == ASTLine::SYMBOL_SET_LINE || l.type == ASTLine::EXPRESSION_LINE)
+				gSink += (size_t)lex.Parse(line + l.value, l.value_length, lex.GetArena());
+			lex.GetArena().Reset();
+		}
+	});
+	Register("pipeline/sequential", n, "lines", []() {
+		ASTInterpreter m;
+		ASTLineReader reader;
+		const char *line;
+		size_t length;
+
+		reader.Open(gPipelineScript.path);
+		while (reader.Next(line, length)) {
+			m.Run(line, length);
+			while (!m.IsStackEmpty())
+				gSink += (size_t)m.PopFromStack();
+		}
+	});
+	Register("pipeline/parsed_ahead", n, "lines", []() {
+		ASTInterpreter m;
+		ASTLineReader reader;
+		const ASTIncludeEntry *entry;
+		int line;
+
+		reader.Open(gPipelineScript.path);
+		ASTPipeline pipeline(reader);
+		while (pipeline.Next(entry, line)) {
+			m.RunEntry(*entry);
+			while (!m.IsStackEmpty())
+				gSink += (size_t)m.PopFromStack();
+		}
+	});
+}
+
+static ScriptFile gPrelude;
+
+// A prelude of directives and assignments included over and over, against
+// running its text line by line, which is what every include used to cost
+// besides reading the file.
+static void RegisterInclude() {
+	char path[] = "/tmp/ast_yet_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return;
+	close(fd);
+
+	shared_ptr<vector<string>> lines = make_shared<vector<string>>();
+	for (int i = 0; i < 16; i++) {
+		lines->push_back("@[$f" + to_string(i) + "$ (_ + " + to_string(i) + ") * (_ - 1) / 2]");
+		lines->push_back("@v" + to_string(i) + " = f" + to_string(i) + "(" + to_string(i) + "; 3) ^ 2 + v" + to_string(i) + " * 0.5");
+		lines->push_back("# a comment");
+	}
+
+	{
+		ofstream fp(path);
+		for (const string &l : *lines)
+			fp << l << "\n";
+	}
+
+	gPrelude.path = path;
+	const string include = "@[!" + gPrelude.path + "]";
+
+	ASTInterpreter *cached = new ASTInterpreter();
+	ASTInterpreter *text = new ASTInterpreter();
+	for (int i = 0; i < 16; i++) {
+		cached->SetSymbol("v" + to_string(i), 0);
+		text->SetSymbol("v" + to_string(i), 0);
+	}
+
+	Register("include/prelude", lines->size(), "lines", [cached, include]() {
+		cached->Run(include);
+	});
+	Register("include/prelude/text", lines->size(), "lines", [text, lines]() {
+		for (const string &l : *lines)
+			text->Run(l);
+	});
+}
+
+// -- MARK: Checks
+
+// Parse time per term must stay flat from 10k to 1M terms, for operator
+// mixes as well as degenerate right-associative chains and deep nesting.
+static bool CheckParseScaling() {
+	static const size_t sizes[] = { 10000, 100000, 1000000 };
+	static const struct {
+		const char *name;
+		string (*make)(size_t);
+	} shapes[] = {
+		{ "mixed", SyntheticExpression },
+		{ "pow_chain", PowerChain },
+		{ "nested", NestedParenthesis },
+	};
+	bool ok = true;
+
+	for (auto &shape : shapes) {
+		double first = 0;
+
+		for (size_t n : sizes) {
+			string code = shape.make(n);
+			double best = 0;
+
+			for (int r = 0; r < 3; r++) {
+				ASTLex lex;
+				Clock::time_point begin = Clock::now();
+				lex.Parse(code);
+				lex.GetArena().Reset();
+				double ns = chrono::duration<double, nano>(Clock::now() - begin).count() / n;
+				if (r == 0 || ns < best)
+					best = ns;
+			}
+
+			if (n == sizes[0])
+				first = best;
+
+			bool linear = best <= first * 4;
+			ok = ok && linear;
+			printf("parse/scaling/%-18s %8zu terms %10.1f ns/term %s\n", shape.name, n, best, linear ? "" : "NOT LINEAR");
+		}
+	}
+
+	return ok;
+}
+
+// The table classifier must agree with the old patterns on every line.
+static bool CheckClassifier(const vector<string> &lines) {
+	RegexClassifier re;
+	size_t mismatches = 0;
+
+	for (const string &l : lines) {
+		string a = re.Classify(l), b = Describe(l);
+		if (a != b) {
+			printf("classify/agree mismatch [%s]: regex %s, table %s\n", l.c_str(), a.c_str(), b.c_str());
+			mismatches++;
+		}
+	}
+
+	printf("classify/agree %zu lines, %zu mismatches\n", lines.size(), mismatches);
+	return mismatches == 0;
+}
+
+// -- MARK: main
+
+int main(int argc, char **argv) {
+	string path("tests/test.txt"), filter, json;
+	vector<const BenchCase*> measured;
+	double min_seconds = 0.5;
+
+	for (int i=1; i<argc; i++) {
+		string opt(argv[i]);
+		if (opt == "-file" && i+1 < argc) {
+			path = argv[++i];
+		} else if (opt == "-time" && i+1 < argc) {
+			min_seconds = atof(argv[++i]);
+		} else if (opt == "-json" && i+1 < argc) {
+			json = argv[++i];
+		} else if (!opt.empty() && opt[0] != '-') {
+			filter = opt;
+		} else {
+			cout << "usage: " << argv[0] << " [-file tests/test.txt] [-time seconds] [-json out.json] [filter]" << endl;
+			return 1;
+		}
+	}
+
+	vector<string> lines = ReadTestLines(path);
+	if (lines.empty()) {
+		cout << "Cannot read test lines from " << path << endl;
+		return 1;
+	}
+
+	string big = SyntheticExpression(100000);
+	vector<string> classified = ClassifierLines(lines);
+
+	RegisterClassifier(classified);
+	RegisterLexer(lines, big);
+	RegisterParser(lines, big);
+	RegisterRun(lines);
+	RegisterResolve();
+	RegisterShapes();
+	RegisterSymbols();
+	RegisterPostfix(lines);
+	RegisterNumber();
+	RegisterEvaluate();
+	RegisterCalls();
+	RegisterMemo();
+	RegisterJit();
+	RegisterBatch();
+	RegisterThreads();
+	RegisterSharing(filter);
+	RegisterReader(filter);
+	RegisterPipeline(filter);
+	RegisterInclude();
+
+	for (BenchCase &c : gCases) {
+		if (filter.empty() || c.name.find(filter) != string::npos) {
+			Measure(c, min_seconds);
+			measured.push_back(&c);
+		}
+	}
+
+	if (!json.empty() && !WriteJSON(json, measured)) {
+		cout << "Cannot write " << json << endl;
+		return 1;
+	}
+
+	bool ok = true;
+	if (filter.empty() || string("classify/agree").find(filter) != string::npos)
+		ok = CheckClassifier(classified) && ok;
+	if (filter.empty() || string("parse/scaling").find(filter) != string::npos)
+		ok = CheckParseScaling() && ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+#include "classifier.hpp"
+
+#include <cstring>
+
+using namespace std;
+
+static unsigned char sCharClass[256];
+
+static bool InitCharClass() {
+	for (int c = 0; c < 256; c++) {
+		unsigned char m = 0;
+
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r')
+			m |= ASTClassifier::SPACE_CLASS;
+		if (c == '\n' || c == '\r')
+			m |= ASTClassifier::TERMINATOR_CLASS;
+		if (c >= '0' && c <= '9')
+			m |= ASTClassifier::DIGIT_CLASS | ASTClassifier::TAIL_CLASS;
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_')
+			m |= ASTClassifier::HEAD_CLASS | ASTClassifier::TAIL_CLASS;
+		// expressions only skip these, "\r" or "\v" are part of a word
+		if (c == ' ' || c == '\t' || c == '\n')
+			m |= ASTClassifier::BLANK_CLASS | ASTClassifier::DELIMITER_CLASS;
+		if (c == '(' || c == ')' || c == ';' || c == '+' || c == '-' ||
+			c == '*' || c == '/' || c == '%' || c == '^' || c == '=')
+			m |= ASTClassifier::DELIMITER_CLASS;
+
+		sCharClass[c] = m;
+	}
+
+	return true;
+}
+
+static const bool sCharClassReady = InitCharClass();
+
+// -- MARK: Characters
+
+bool ASTClassifier::Is(char c, int mask) {
+	return (sCharClass[(unsigned char)c] & mask) != 0;
+}
+
+bool ASTClassifier::IsSpace(char c) {
+	return Is(c, SPACE_CLASS);
+}
+
+bool ASTClassifier::IsDigit(char c) {
+	return Is(c, DIGIT_CLASS);
+}
+
+bool ASTClassifier::IsIdentifierHead(char c) {
+	return Is(c, HEAD_CLASS);
+}
+
+bool ASTClassifier::IsIdentifierTail(char c) {
+	return Is(c, TAIL_CLASS);
+}
+
+// -- MARK: Words
+
+bool ASTClassifier::IsIdentifier(const char *s, size_t n) {
+	return n > 0 && IsIdentifierHead(s[0]) && SkipIdentifier(s, 0, n) == n;
+}
+
+bool ASTClassifier::IsIdentifier(const string &s) {
+	return IsIdentifier(s.data(), s.length());
+}
+
+bool ASTClassifier::IsNumber(const char *s, size_t n) {
+	size_t i = 0;
+
+	while (i < n && IsDigit(s[i]))
+		i++;
+
+	if (i == 0)
+		return false;
+	else if (i == n)
+		return true;
+	else if (s[i] != '.' || ++i == n)
+		return false;
+
+	while (i < n && IsDigit(s[i]))
+		i++;
+
+	return i == n;
+}
+
+bool ASTClassifier::IsNumber(const string &s) {
+	return IsNumber(s.data(), s.length());
+}
+
+bool ASTClassifier::IsConstant(const char *s, size_t n) {
+	return n == 3 && (memcmp(s, "inf", 3) == 0 || memcmp(s, "nan", 3) == 0);
+}
+
+bool ASTClassifier::IsConstant(const string &s) {
+	return IsConstant(s.data(), s.length());
+}
+
+// -- MARK: Lines
+
+ASTLine ASTClassifier::Classify(const string &s) {
+	return Classify(s.data(), s.length());
+}
+
+ASTLine ASTClassifier::Classify(const char *s, size_t n) {
+	ASTLine l;
+	size_t i = SkipSpace(s, 0, n);
+
+	if (i < n && (s[i] == '@' || s[i] == '#')) {
+		size_t j = i + 1;
+		while (j < n && !Is(s[j], TERMINATOR_CLASS))
+			j++;
+
+		// `.*` never spans a line terminator
+		if (j == n) {
+			if (s[i] == '@')
+				return ClassifyDirective(s, i + 1, n);
+
+			l.type = ASTLine::COMMENT_LINE;
+			l.key = l.key_length = 0;
+			l.value = i + 1;
+			l.value_length = n - l.value;
+			return l;
+		}
+	}
+
+	l.type = ASTLine::EXPRESSION_LINE;
+	l.key = l.key_length = 0;
+	l.value = 0;
+	l.value_length = n;
+	return l;
+}
+
+ASTLine ASTClassifier::ClassifyDirective(const char *s, size_t b, size_t n) {
+	ASTLine l;
+	l.type = ASTLine::INVALID_DIRECTIVE_LINE;
+	l.key = l.key_length = l.value = l.value_length = 0;
+
+	if (b < n && s[b] == '[') {
+		// the body always ends on the last `]`, only spaces may follow
+		size_t end = TrimSpace(s, b, n);
+		bool closed = end > b + 1 && s[end - 1] == ']';
+
+		if (b + 1 < n && s[b + 1] == '!') {
+			if (closed && end - 1 > b + 2) {
+				l.type = ASTLine::INCLUDE_LINE;
+				l.value = b + 2;
+
+				if (s[b + 2] == '!' && end - 1 > b + 3) {
+					l.type = ASTLine::INCLUDE_ONCE_LINE;
+					l.value++;
+				}
+
+				l.value_length = end - 1 - l.value;
+			}
+			return l;
+		}
+
+		size_t i = SkipSpace(s, b + 1, n);
+
+		if (i < n && s[i] == '$') {
+			size_t e = SkipIdentifier(s, i + 1, n);
+
+			if (closed && e > i + 1 && IsIdentifierHead(s[i + 1]) && e < n && s[e] == '$') {
+				l.type = ASTLine::DIRECTIVE_SET_LINE;
+				l.key = i + 1;
+				l.key_length = e - l.key;
+				l.value = SkipSpace(s, e + 1, n);
+				l.value_length = end - 1 - l.value;
+			}
+		} else if (i < n && IsIdentifierHead(s[i])) {
+			size_t e = SkipIdentifier(s, i, n);
+			size_t j = SkipSpace(s, e, n);
+
+			if (j < n && s[j] == ']' && SkipSpace(s, j + 1, n) == n) {
+				l.type = ASTLine::DIRECTIVE_CALL_LINE;
+				l.key = i;
+				l.key_length = e - i;
+			}
+		}
+	} else if (b < n && IsIdentifierHead(s[b])) {
+		size_t e = SkipIdentifier(s, b, n);
+		size_t j = SkipSpace(s, e, n);
+
+		if (j < n && s[j] == '=') {
+			l.type = ASTLine::SYMBOL_SET_LINE;
+			l.key = b;
+			l.key_length = e - b;
+			l.value = SkipSpace(s, j + 1, n);
+			l.value_length = n - l.value;
+		}
+	}
+
+	return l;
+}
+
+size_t ASTClassifier::SkipSpace(const char *s, size_t i, size_t n) {
+	while (i < n && IsSpace(s[i]))
+		i++;
+	return i;
+}
+
+size_t ASTClassifier::SkipIdentifier(const char *s, size_t i, size_t n) {
+	while (i < n && IsIdentifierTail(s[i]))
+		i++;
+	return i;
+}
+
+size_t ASTClassifier::TrimSpace(const char *s, size_t begin, size_t n) {
+	while (n > begin && IsSpace(s[n - 1]))
+		n--;
+	return n;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+struct ASTLine {
+	typedef enum {
+		EXPRESSION_LINE,
+		COMMENT_LINE,
+		DIRECTIVE_SET_LINE,
+		DIRECTIVE_CALL_LINE,
+		SYMBOL_SET_LINE,
+		INCLUDE_LINE,
+		// `@[!!path]`, skipped when the file was already included
+		INCLUDE_ONCE_LINE,
+		INVALID_DIRECTIVE_LINE,
+	} LineType;
+
+	LineType type;
+	// name and value (body, expression or path) as offsets into the line
+	size_t key, key_length;
+	size_t value, value_length;
+};
+
+// Hand-written replacement for the line and name patterns of the grammar:
+//   comment    ^\s*#(.*)$
+//   directive  ^\s*@(.*)$, then one of
+//     set      ^\[\s*\$(NAME)\$\s*((.*)\s*){0,1}\]\s*$
+//     call     ^\[\s*(NAME)\s*\]\s*$
+//     symbol   ^(NAME)\s*=\s*(.*)\s*$
+//     include  ^\[!(.+)\]\s*$, once when (.+) is !(.+)
+// where NAME is [A-Za-z_][A-Za-z0-9_]* and `.` is anything but \n and \r.
+class ASTClassifier {
+public:
+	typedef enum {
+		SPACE_CLASS = 1 << 0,
+		TERMINATOR_CLASS = 1 << 1,
+		DIGIT_CLASS = 1 << 2,
+		HEAD_CLASS = 1 << 3,
+		TAIL_CLASS = 1 << 4,
+		BLANK_CLASS = 1 << 5,
+		DELIMITER_CLASS = 1 << 6,
+	} CharClass;
+
+	static ASTLine Classify(const string &s);
+	static ASTLine Classify(const char *s, size_t n);
+
+	static bool Is(char c, int mask);
+	static bool IsSpace(char c);
+	static bool IsDigit(char c);
+	static bool IsIdentifierHead(char c);
+	static bool IsIdentifierTail(char c);
+	static bool IsIdentifier(const char *s, size_t n);
+	static bool IsIdentifier(const string &s);
+	static bool IsNumber(const char *s, size_t n);
+	static bool IsNumber(const string &s);
+	static bool IsConstant(const char *s, size_t n);
+	static bool IsConstant(const string &s);
+protected:
+	static ASTLine ClassifyDirective(const char *s, size_t begin, size_t n);
+	static size_t SkipSpace(const char *s, size_t i, size_t n);
+	static size_t SkipIdentifier(const char *s, size_t i, size_t n);
+	static size_t TrimSpace(const char *s, size_t begin, size_t n);
+};
@@ -0,0 +1,341 @@
+#include "compiler.hpp"
+
+#include "names.hpp"
+
+using namespace std;
+
+void ASTProgram::Clear() {
+	code.clear();
+	names.clear();
+	sites.clear();
+	depth = 0;
+	locals = reuses = pushes = 0;
+	returns = false;
+	effects = ASTEffects();
+}
+
+ASTCallSite::BuiltinType ASTCallSite::GetBuiltin(unsigned id) {
+	if (id >= ASTNameTable::CMP_EQ_NAME && id <= ASTNameTable::CMP_GTE_NAME)
+		return (BuiltinType)(CMP_EQ_BUILTIN + (id - ASTNameTable::CMP_EQ_NAME));
+
+	return NO_BUILTIN;
+}
+
+// -- MARK: Compilation
+
+// A value worth keeping: pure, not a leaf and reached more than once.
+static inline ASTShareInfo* GetShared(unordered_map<Entity*, ASTShareInfo> &info, Entity *e) {
+	if (info.empty() || e->GetType() == Entity::OPERAND_ENTITY || e->GetType() == Entity::LITERAL_ENTITY)
+		return nullptr;
+
+	unordered_map<Entity*, ASTShareInfo>::iterator it = info.find(e);
+	return it != info.end() && it->second.uses > 1 && it->second.pure ? &it->second : nullptr;
+}
+
+void ASTCompiler::Compile(Entity *root, ASTProgram &p, bool shared, ASTCallOracle *calls) {
+	vector<ASTCompileFrame> &frames = mFrames;
+	unordered_map<Entity*, ASTShareInfo> &info = mInfo;
+	Entity *kept = root;
+	// may go negative below an error, nothing after one runs anyway
+	long depth = 0;
+	// bumped by anything that may change what a pure expression reads
+	unsigned epoch = 0;
+
+	p.Clear();
+	frames.clear();
+	info.clear();
+
+	if (shared)
+		Share(root, calls);
+
+	// a call at the root leaves its result where the directive put it
+	while (kept != nullptr && kept->GetType() == Entity::PARENTHESIS_ENTITY &&
+		   !((ParenthesisEntity*)kept)->IsNegative())
+		kept = ((ParenthesisEntity*)kept)->Get();
+
+	if (kept != nullptr && kept->GetType() != Entity::FUNCTION_ENTITY)
+		kept = nullptr;
+
+	frames.push_back({root, false});
+
+	while (!frames.empty()) {
+		ASTCompileFrame f = frames.back();
+		Entity *e = f.e;
+		frames.pop_back();
+
+		if (e == nullptr) {
+			Emit(p, ASTInstruction::RAISE_VALUE_ERROR, AddName(p, "cannot resolve null entity"));
+			continue;
+		}
+
+		if (ASTShareInfo *s = f.done ? nullptr : GetShared(info, e)) {
+			if (s->stored && s->epoch == epoch) {
+				Emit(p, ASTInstruction::LOAD_LOCAL, s->local);
+				p.reuses++;
+				if (++depth > (long)p.depth)
+					p.depth = depth;
+				continue;
+			}
+		}
+
+		switch (e->GetType()) {
+		case Entity::PARENTHESIS_ENTITY: {
+			ParenthesisEntity *pe = (ParenthesisEntity*)e;
+
+			if (!f.done) {
+				// nothing to do afterwards unless it negates or is kept
+				if (pe->IsNegative() || !info.empty())
+					frames.push_back({e, true});
+				frames.push_back({pe->Get(), false});
+			} else if (pe->IsNegative()) {
+				Emit(p, ASTInstruction::NEGATE);
+			}
+			break;
+		}
+		case Entity::COMPOUND_ENTITY: {
+			CompoundEntity *ce = (CompoundEntity*)e;
+			Entity *l = ce->Get(CompoundEntity::LEFT_ENTITY),
+				   *r = ce->Get(CompoundEntity::RIGHT_ENTITY);
+			TieredEntity::OperatorType op = ce->GetOperator();
+
+			if (op == TieredEntity::OPERATOR_SET) {
+				if (l == nullptr || l->GetType() != Entity::OPERAND_ENTITY) {
+					Emit(p, ASTInstruction::RAISE_INVALID_OPERATION,
+						 AddName(p, "invalid operand for assignment operation"));
+				} else if (!f.done) {
+					frames.push_back({e, true});
+					frames.push_back({r, false});
+				} else if (((OperandEntity*)l)->IsNegative()) {
+					// only caught once the value is known, like any other bad name
+					Emit(p, ASTInstruction::RAISE_VALUE_ERROR, AddName(p, "invalid symbol name"));
+				} else {
+					Emit(p, ASTInstruction::STORE_SYMBOL, ((OperandEntity*)l)->GetName());
+					p.effects.stores = true;
+					epoch++;
+					// `_ =` pushes
+					if (((OperandEntity*)l)->GetName() == ASTNameTable::STACK_TOP_NAME)
+						p.pushes++;
+				}
+			} else if (op < TieredEntity::ARITHMETIC_ADD || op > TieredEntity::ARITHMETIC_POW) {
+				Emit(p, ASTInstruction::RAISE_INVALID_OPERATION,
+					 AddName(p, "invalid operation " + ce->GetOperatorString()));
+			} else if (!f.done) {
+				// the left side runs first
+				frames.push_back({e, true});
+				frames.push_back({r, false});
+				frames.push_back({l, false});
+			} else {
+				Emit(p, (ASTInstruction::OpCode)(ASTInstruction::ARITHMETIC_ADD + (op - TieredEntity::ARITHMETIC_ADD)));
+				depth--;
+			}
+			break;
+		}
+		case Entity::OPERAND_ENTITY: {
+			OperandEntity *oe = (OperandEntity*)e;
+			Emit(p, ASTInstruction::LOAD_SYMBOL, oe->GetName()).negative = oe->IsNegative();
+			depth++;
+
+			if (oe->GetName() == ASTNameTable::STACK_TOP_NAME) {
+				p.effects.pops++;
+				epoch++;
+			} else if (oe->GetName() == ASTNameTable::STACK_SIZE_NAME) {
+				p.effects.reads_stack_size = true;
+			} else {
+				p.effects.reads_symbols = true;
+			}
+			break;
+		}
+		case Entity::LITERAL_ENTITY: {
+			Emit(p, ASTInstruction::PUSH_LITERAL).value = ((LiteralEntity*)e)->GetNumber();
+			depth++;
+			break;
+		}
+		case Entity::FUNCTION_ENTITY: {
+			FunctionEntity *fe = (FunctionEntity*)e;
+			const size_t n = fe->GetArgumentsLength();
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				for (size_t a = n; a > 0; a--)
+					frames.push_back({fe->GetArgument(a - 1), false});
+			} else {
+				ASTInstruction &i = Emit(p, ASTInstruction::CALL_DIRECTIVE, fe->GetName());
+				i.site = p.sites.size();
+				p.sites.push_back(ASTCallSite());
+				i.negative = fe->IsNegative();
+				i.keep = e == kept;
+				i.argc = n;
+				p.pushes += n + i.keep;
+				depth -= n;
+				if (!i.keep)
+					depth++;
+				if (calls == nullptr || !calls->IsPureCall(i.name, n))
+					epoch++;
+			}
+			break;
+		}
+		case Entity::INVALID_ENTITY:
+		default:
+			Emit(p, ASTInstruction::RAISE_TYPE_ERROR, AddName(p, string("cannot resolve entity ") + e->GetTypeString()));
+			break;
+		}
+
+		if (ASTShareInfo *s = f.done ? GetShared(info, e) : nullptr) {
+			if (!s->stored)
+				s->local = p.locals++;
+			Emit(p, ASTInstruction::STORE_LOCAL, s->local);
+			s->stored = true;
+			s->epoch = epoch;
+		}
+
+		if (depth > (long)p.depth)
+			p.depth = depth;
+	}
+
+	if (kept == nullptr) {
+		Emit(p, ASTInstruction::RETURN_VALUE);
+		p.pushes++;
+		p.returns = true;
+	}
+}
+
+// Counts the parents of every node of a DAG and finds which ones are pure:
+// literals, symbols other than `_` and `__`, arithmetic on pure values and
+// pure calls on pure arguments.
+void ASTCompiler::Share(Entity *root, ASTCallOracle *calls) {
+	vector<ASTCompileFrame> &frames = mFrames;
+	unordered_map<Entity*, ASTShareInfo> &info = mInfo;
+
+	frames.push_back({root, false});
+
+	while (!frames.empty()) {
+		ASTCompileFrame f = frames.back();
+		Entity *e = f.e;
+		frames.pop_back();
+
+		if (e == nullptr)
+			continue;
+
+		ASTShareInfo &s = info[e];
+
+		// the first visit has already been through the whole subtree
+		if (!f.done && s.uses++ > 0)
+			continue;
+
+		switch (e->GetType()) {
+		case Entity::PARENTHESIS_ENTITY: {
+			Entity *inner = ((ParenthesisEntity*)e)->Get();
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				frames.push_back({inner, false});
+			} else {
+				s.pure = inner != nullptr && info[inner].pure;
+			}
+			break;
+		}
+		case Entity::COMPOUND_ENTITY: {
+			CompoundEntity *ce = (CompoundEntity*)e;
+			Entity *l = ce->Get(CompoundEntity::LEFT_ENTITY),
+				   *r = ce->Get(CompoundEntity::RIGHT_ENTITY);
+			TieredEntity::OperatorType op = ce->GetOperator();
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				frames.push_back({r, false});
+				// the target of an assignment is never evaluated
+				if (op != TieredEntity::OPERATOR_SET)
+					frames.push_back({l, false});
+			} else {
+				s.pure = op >= TieredEntity::ARITHMETIC_ADD && op <= TieredEntity::ARITHMETIC_POW &&
+					l != nullptr && r != nullptr && info[l].pure && info[r].pure;
+			}
+			break;
+		}
+		case Entity::FUNCTION_ENTITY: {
+			FunctionEntity *fe = (FunctionEntity*)e;
+			const size_t n = fe->GetArgumentsLength();
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				for (size_t a = n; a > 0; a--)
+					frames.push_back({fe->GetArgument(a - 1), false});
+				break;
+			}
+
+			s.pure = calls != nullptr && calls->IsPureCall(fe->GetName(), n);
+			for (size_t a = 0; a < n && s.pure; a++)
+				s.pure = fe->GetArgument(a) != nullptr && info[fe->GetArgument(a)].pure;
+			break;
+		}
+		case Entity::OPERAND_ENTITY: {
+			unsigned name = ((OperandEntity*)e)->GetName();
+			s.pure = name != ASTNameTable::STACK_TOP_NAME && name != ASTNameTable::STACK_SIZE_NAME;
+			break;
+		}
+		case Entity::LITERAL_ENTITY:
+			s.pure = true;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+string ASTCompiler::GetOpCodeString(ASTInstruction::OpCode op) {
+	switch (op) {
+	case ASTInstruction::PUSH_LITERAL:
+		return "push_literal";
+	case ASTInstruction::LOAD_SYMBOL:
+		return "load_symbol";
+	case ASTInstruction::STORE_SYMBOL:
+		return "store_symbol";
+	case ASTInstruction::ARITHMETIC_ADD:
+		return "+";
+	case ASTInstruction::ARITHMETIC_SUB:
+		return "-";
+	case ASTInstruction::ARITHMETIC_MUL:
+		return "*";
+	case ASTInstruction::ARITHMETIC_DIV:
+		return "/";
+	case ASTInstruction::ARITHMETIC_MOD:
+		return "%";
+	case ASTInstruction::ARITHMETIC_POW:
+		return "^";
+	case ASTInstruction::NEGATE:
+		return "negate";
+	case ASTInstruction::CALL_DIRECTIVE:
+		return "call_directive";
+	case ASTInstruction::STORE_LOCAL:
+		return "store_local";
+	case ASTInstruction::LOAD_LOCAL:
+		return "load_local";
+	case ASTInstruction::RETURN_VALUE:
+		return "return_value";
+	case ASTInstruction::RAISE_VALUE_ERROR:
+	case ASTInstruction::RAISE_TYPE_ERROR:
+	case ASTInstruction::RAISE_INVALID_OPERATION:
+		return "raise";
+	default:
+		return "invalid";
+	}
+}
+
+unsigned ASTCompiler::AddName(ASTProgram &p, const string &s) {
+	p.names.push_back(s);
+	return p.names.size() - 1;
+}
+
+ASTInstruction& ASTCompiler::Emit(ASTProgram &p, ASTInstruction::OpCode op, unsigned name) {
+	ASTInstruction i;
+	i.op = op;
+	i.negative = false;
+	i.keep = false;
+	i.name = name;
+	i.argc = 0;
+	i.site = 0;
+	i.value = 0;
+
+	p.code.push_back(i);
+	return p.code.back();
+}
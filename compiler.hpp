@@ -0,0 +1,168 @@
+#pragma once
+
+#include "entities/entities.hpp"
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct ASTDirective;
+
+// What a CALL_DIRECTIVE resolved to the last time it ran. It stays valid
+// while the version of the directive's slot is unchanged, so a steady-state
+// call skips the lookup entirely.
+struct ASTCallSite {
+	typedef enum {
+		NO_BUILTIN,
+		// `_` and `__` exist but cannot be called unless defined
+		NULL_BUILTIN,
+		CMP_EQ_BUILTIN,
+		CMP_NEQ_BUILTIN,
+		CMP_LT_BUILTIN,
+		CMP_LTE_BUILTIN,
+		CMP_GT_BUILTIN,
+		CMP_GTE_BUILTIN,
+	} BuiltinType;
+
+	ASTDirective *directive = nullptr;
+	BuiltinType builtin = NO_BUILTIN;
+	// never a slot version, so a new site always resolves once
+	unsigned version = -1;
+
+	// The builtin behind an interned name, if any.
+	static BuiltinType GetBuiltin(unsigned id);
+};
+
+// One step of a compiled expression. Values flow through a private operand
+// stack; only `_`, `__`, assignments to `_` and directive calls touch the
+// user-visible interpreter stack, exactly as the tree walker did.
+struct ASTInstruction {
+	typedef enum {
+		PUSH_LITERAL,
+		LOAD_SYMBOL,
+		STORE_SYMBOL,
+		ARITHMETIC_ADD,
+		ARITHMETIC_SUB,
+		ARITHMETIC_MUL,
+		ARITHMETIC_DIV,
+		ARITHMETIC_MOD,
+		ARITHMETIC_POW,
+		NEGATE,
+		CALL_DIRECTIVE,
+		// keep the top value in local `name`, or push it back
+		STORE_LOCAL,
+		LOAD_LOCAL,
+		// moves the final value onto the interpreter stack
+		RETURN_VALUE,
+		// raise the error the tree walker would have raised at this point
+		RAISE_VALUE_ERROR,
+		RAISE_TYPE_ERROR,
+		RAISE_INVALID_OPERATION,
+	} OpCode;
+
+	OpCode op;
+	bool negative;
+	// a call leaves its result on the interpreter stack instead of popping it
+	bool keep;
+	// the interned symbol or directive, or the message in ASTProgram::names
+	unsigned name;
+	unsigned argc;
+	// index into ASTProgram::sites
+	unsigned site;
+	double value;
+};
+
+// What running a program can do besides computing its value.
+struct ASTEffects {
+	// assigns a symbol or pushes through `_ =`
+	bool stores = false;
+	bool reads_stack_size = false;
+	// reads a symbol other than `_` and `__`
+	bool reads_symbols = false;
+	// values taken off the interpreter stack through `_`
+	unsigned pops = 0;
+};
+
+struct ASTProgram {
+	vector<ASTInstruction> code;
+	vector<string> names;
+	// filled in by the interpreter as the calls run
+	mutable vector<ASTCallSite> sites;
+	// deepest the operand stack gets while running `code`
+	size_t depth = 0;
+	// values kept by STORE_LOCAL, and how many times one was loaded back
+	size_t locals = 0, reuses = 0;
+	// most values `code` itself pushes onto the interpreter stack, call
+	// arguments included, to make room for before running it
+	size_t pushes = 0;
+	// ends in RETURN_VALUE, so it always leaves a value behind
+	bool returns = false;
+	ASTEffects effects;
+
+	void Clear();
+};
+
+// Tells the compiler which calls may be evaluated once and reused: the
+// directive must not touch anything but its own arguments.
+class ASTCallOracle {
+public:
+	virtual bool IsPureCall(unsigned id, unsigned argc) = 0;
+	virtual ~ASTCallOracle() {}
+};
+
+// How a node of a DAG is used: how many parents reach it, whether it can
+// be reused, and where it was last kept.
+struct ASTShareInfo {
+	unsigned uses = 0;
+	bool pure = false;
+	bool stored = false;
+	unsigned local = 0;
+	// the barrier count when it was kept
+	unsigned epoch = 0;
+};
+
+// A node waiting to be emitted; `done` is set once its children are.
+struct ASTCompileFrame {
+	Entity *e;
+	bool done;
+};
+
+class ASTCompiler {
+public:
+	// Flattens `e` into postfix instructions, without recursion. When `e`
+	// is a DAG (see ASTHashCons) with `shared` set, a pure subexpression
+	// reached more than once is evaluated once and kept in a local until an
+	// assignment, a pop of `_` or an impure call; without `calls` every call
+	// is impure. The work buffers are reused from one call to the next.
+	void Compile(Entity *e, ASTProgram &p, bool shared=false, ASTCallOracle *calls=nullptr);
+	static string GetOpCodeString(ASTInstruction::OpCode op);
+
+	// The one definition of ARITHMETIC_*, shared by the interpreter and
+	// constant folding so both produce the same bits.
+	static inline double Apply(ASTInstruction::OpCode op, double l, double r) {
+		switch (op) {
+		case ASTInstruction::ARITHMETIC_ADD:
+			return l + r;
+		case ASTInstruction::ARITHMETIC_SUB:
+			return l - r;
+		case ASTInstruction::ARITHMETIC_MUL:
+			return l * r;
+		case ASTInstruction::ARITHMETIC_DIV:
+			return l / r;
+		case ASTInstruction::ARITHMETIC_MOD:
+			return fmod(l, r);
+		default:
+			return pow(l, r);
+		}
+	}
+protected:
+	vector<ASTCompileFrame> mFrames;
+	unordered_map<Entity*, ASTShareInfo> mInfo;
+
+	void Share(Entity *root, ASTCallOracle *calls);
+	static unsigned AddName(ASTProgram &p, const string &s);
+	static ASTInstruction& Emit(ASTProgram &p, ASTInstruction::OpCode op, unsigned name=0);
+};
@@ -29,20 +29,9 @@ Entity* CompoundEntity::Get(EntityPosition pos) {
 }
 
 string CompoundEntity::GetString() {
-	string ls, rs;
-	Entity *le = Get(LEFT_ENTITY), *re = Get(RIGHT_ENTITY);
-
-	if (le == nullptr)
-		ls = "NULL";
-	else
-		ls = le->GetString();
-
-	if (re == nullptr)
-		rs = "NULL";
-	else
-		rs = re->GetString();
-
-	return ls + GetOperatorString() + rs;
+	string s;
+	WriteString(this, s);
+	return s;
 }
 
 void CompoundEntity::Set(EntityPosition pos, Entity *value) {
@@ -63,10 +52,4 @@ void CompoundEntity::Set(EntityPosition pos, Entity *value) {
 	}
 }
 
-CompoundEntity::~CompoundEntity() {
-	if (mLeft != nullptr)
-		delete mLeft;
-
-	if (mRight != nullptr)
-		delete mRight;
-}
\ No newline at end of file
+CompoundEntity::~CompoundEntity() {}
\ No newline at end of file
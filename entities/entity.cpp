@@ -1,5 +1,7 @@
 #include "entity.hpp"
+#include "compound_entity.hpp"
 #include "exceptions.hpp"
+#include "parenthesis_entity.hpp"
 
 Entity::EntityType Entity::GetType() {
 	return INVALID_ENTITY;
@@ -33,3 +35,45 @@ string Entity::GetString() {
 }
 
 Entity::~Entity() {}
+
+// -- MARK: Printing
+
+// Either a node still to be written or a piece of text to append.
+struct ASTInfixStep {
+	Entity *e;
+	const char *text;
+	// the operator of compound `e`
+	bool op;
+};
+
+void Entity::WriteString(Entity *root, string &out) {
+	vector<ASTInfixStep> steps;
+	steps.push_back({root, nullptr, false});
+
+	while (!steps.empty()) {
+		ASTInfixStep s = steps.back();
+		steps.pop_back();
+
+		if (s.text != nullptr) {
+			out += s.text;
+		} else if (s.op) {
+			out += ((CompoundEntity*)s.e)->GetOperatorString();
+		} else if (s.e == nullptr) {
+			out += "NULL";
+		} else if (s.e->GetType() == COMPOUND_ENTITY) {
+			CompoundEntity *ce = (CompoundEntity*)s.e;
+
+			steps.push_back({ce->Get(CompoundEntity::RIGHT_ENTITY), nullptr, false});
+			steps.push_back({ce, nullptr, true});
+			steps.push_back({ce->Get(CompoundEntity::LEFT_ENTITY), nullptr, false});
+		} else if (s.e->GetType() == PARENTHESIS_ENTITY) {
+			ParenthesisEntity *pe = (ParenthesisEntity*)s.e;
+
+			out += pe->IsNegative() ? "-(" : "(";
+			steps.push_back({nullptr, ")", false});
+			steps.push_back({pe->Get(), nullptr, false});
+		} else {
+			out += s.e->GetString();
+		}
+	}
+}
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 using namespace std;
 
+// Entities are allocated in an ASTArena which owns them; destroying an
+// entity never touches its children.
 class Entity {
 public:
 	typedef enum {
@@ -26,4 +29,8 @@ public:
 	virtual const char* GetTypeString();
 	virtual string GetString();
 	virtual ~Entity();
+
+	// Appends the infix form of `e` to `out` without recursion, so trees of
+	// any depth can be printed; leaves are written by their GetString.
+	static void WriteString(Entity *e, string &out);
 };
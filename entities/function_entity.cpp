@@ -1,14 +1,32 @@
 #include "function_entity.hpp"
 
-#include <regex>
+#include "classifier.hpp"
+#include "names.hpp"
+
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 
 FunctionEntity::FunctionEntity(string value) : OperandEntity(value) {}
 
-bool FunctionEntity::IsValid(string value) {
-	regex pattern("^-{0,1}[A-Za-z_]{1}[A-Za-z0-9]*$");
-	return value != "inf" && value != "nan" && regex_match(value, pattern);
+FunctionEntity::FunctionEntity(string value, bool negative) : OperandEntity(value, negative) {}
+
+FunctionEntity::FunctionEntity(unsigned name, bool negative) : OperandEntity(name, negative) {}
+
+bool FunctionEntity::IsValid(const string &value) {
+	// ^-{0,1}[A-Za-z_]{1}[A-Za-z0-9]*$, no underscores after the first character
+	size_t i = !value.empty() && value[0] == '-';
+
+	if (ASTClassifier::IsConstant(value) || i == value.length() || !ASTClassifier::IsIdentifierHead(value[i]))
+		return false;
+
+	while (++i < value.length()) {
+		if (value[i] == '_' || !ASTClassifier::IsIdentifierTail(value[i]))
+			return false;
+	}
+
+	return true;
 }
 
 Entity::EntityType FunctionEntity::GetType() {
@@ -18,48 +36,80 @@ Entity::EntityType FunctionEntity::GetType() {
 void FunctionEntity::SetValue(string value) {
 	if (IsValid(value)) {
 		if (value[0] == '-') {
-			mValue = value.substr(1);
+			mName = ASTNameTable::Intern(value.data() + 1, value.length() - 1);
 			SetNegative(true);
-		} else mValue = value;
+		} else mName = ASTNameTable::Intern(value);
 	} else {
 		throw ASTValueError("invalid directive");
 	}
 }
 
 size_t FunctionEntity::GetArgumentsLength() {
-	return this->size();
+	return mLength;
 }
 
 bool FunctionEntity::HasArguments() {
-	return !this->empty();
+	return mLength != 0;
 }
 
 void FunctionEntity::AddArgument(Entity *entity) {
-	this->push_back(entity);
+	if (mLength == mCapacity)
+		ReserveArguments(mCapacity ? mCapacity * 2 : 4);
+
+	mArguments[mLength++] = entity;
+}
+
+void FunctionEntity::ReserveArguments(size_t n) {
+	if (n <= mCapacity)
+		return;
+
+	Entity **arguments = new Entity*[n];
+	copy(mArguments, mArguments + mLength, arguments);
+
+	if (mOwned)
+		delete[] mArguments;
+
+	mArguments = arguments;
+	mCapacity = n;
+	mOwned = true;
+}
+
+void FunctionEntity::ReserveArguments(size_t n, ASTArena &arena) {
+	if (n <= mCapacity)
+		return;
+
+	Entity **arguments = (Entity**)arena.Allocate(n * sizeof(Entity*), alignof(Entity*));
+	copy(mArguments, mArguments + mLength, arguments);
+
+	if (mOwned)
+		delete[] mArguments;
+
+	mArguments = arguments;
+	mCapacity = n;
+	mOwned = false;
 }
 
 Entity* FunctionEntity::PopArgument() {
-	Entity *ret = this->at(this->size()-1);
-	this->pop_back();
+	if (mLength == 0)
+		throw out_of_range("no argument to pop");
 
-	return ret;
+	return mArguments[--mLength];
+}
+
+Entity* FunctionEntity::GetArgument(size_t i) {
+	return mArguments[i];
 }
 
 vector<Entity*> FunctionEntity::GetArguments() {
-	vector<Entity*> ret;
-	for (vector<Entity*>::iterator it = this->begin(); it != this->end(); ++it) {
-		ret.push_back(*it);
-	}
-	return ret;
+	return vector<Entity*>(mArguments, mArguments + mLength);
 }
 
 void FunctionEntity::ClearArguments() {
-	while(!this->empty()) {
-		delete PopArgument();
-	}
+	// the arguments belong to the arena
+	mLength = 0;
 }
 
-
 FunctionEntity::~FunctionEntity() {
-	ClearArguments();
+	if (mOwned)
+		delete[] mArguments;
 }
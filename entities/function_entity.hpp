@@ -2,14 +2,18 @@
 
 #include "operand_entity.hpp"
 
+#include "arena.hpp"
+
 #include <vector>
 
 using namespace std;
 
-class FunctionEntity final : public OperandEntity, protected vector<Entity*> {
+class FunctionEntity final : public OperandEntity {
 public:
 	FunctionEntity(string value);
-	static bool IsValid(string value);
+	FunctionEntity(string value, bool negative);
+	FunctionEntity(unsigned name, bool negative);
+	static bool IsValid(const string &value);
 	EntityType GetType() override;
 	void SetValue(string value) override;
 
@@ -17,10 +21,22 @@ public:
 	size_t GetArgumentsLength();
 	bool HasArguments();
 	void AddArgument(Entity *entity);
+	void ReserveArguments(size_t n);
+	// Keeps the first `n` arguments in `arena`, which must outlive this.
+	void ReserveArguments(size_t n, ASTArena &arena);
 	Entity* PopArgument();
+	Entity* GetArgument(size_t i);
 	vector<Entity*> GetArguments();
 	void ClearArguments();
 	// -- End arguments
 
 	~FunctionEntity();
+protected:
+	Entity **mArguments = nullptr;
+	size_t mLength = 0, mCapacity = 0;
+	// allocated here rather than in an arena
+	bool mOwned = false;
+private:
+	FunctionEntity(const FunctionEntity&) = delete;
+	FunctionEntity& operator=(const FunctionEntity&) = delete;
 };
@@ -1,6 +1,7 @@
 #include "literal_entity.hpp"
 
-#include <regex>
+#include "classifier.hpp"
+#include "number.hpp"
 
 using namespace std;
 
@@ -10,21 +11,42 @@ LiteralEntity::LiteralEntity(string value) {
 	SetValue(value);
 }
 
-bool LiteralEntity::IsValid(string value) {
-	regex pattern("^-{0,1}[0-9]+(\\.[0-9]+){0,1}$");
-	return value == "inf" || value == "nan" || regex_match(value, pattern);
+LiteralEntity::LiteralEntity(string value, bool negative) {
+	// the value is already validated by the tokenizer
+	mValue = value;
+	ASTNumber::Decode(mValue, mNumber);
+	SetNegative(negative);
+}
+
+LiteralEntity::LiteralEntity(string value, double number, bool negative) {
+	// the value is already validated and decoded by the tokenizer
+	mValue = value;
+	mNumber = number;
+	SetNegative(negative);
+}
+
+bool LiteralEntity::IsValid(const string &value) {
+	// ^-{0,1}[0-9]+(\.[0-9]+){0,1}$
+	size_t sign = !value.empty() && value[0] == '-';
+	return ASTClassifier::IsConstant(value) || ASTClassifier::IsNumber(value.data() + sign, value.length() - sign);
 }
 
 Entity::EntityType LiteralEntity::GetType() {
 	return LITERAL_ENTITY;
 }
 
+double LiteralEntity::GetNumber() {
+	return IsNegative() ? -mNumber : mNumber;
+}
+
 void LiteralEntity::SetValue(string value) {
 	if (IsValid(value)) {
 		if (value[0] == '-') {
 			mValue = value.substr(1);
 			SetNegative(true);
 		} else mValue = value;
+
+		ASTNumber::Decode(mValue, mNumber);
 	} else {
 		throw ASTValueError("invalid value for literal");
 	}
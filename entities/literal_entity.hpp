@@ -6,8 +6,14 @@ class LiteralEntity final : public SingleValueEntity {
 public:
 	LiteralEntity();
 	LiteralEntity(string value);
-	static bool IsValid(string value);
+	LiteralEntity(string value, bool negative);
+	LiteralEntity(string value, double number, bool negative);
+	static bool IsValid(const string &value);
 	EntityType GetType() override;
+	// The decoded value, sign included.
+	double GetNumber();
 	void SetValue(string value) override;
 	~LiteralEntity();
+private:
+	double mNumber = 0;
 };
\ No newline at end of file
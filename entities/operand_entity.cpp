@@ -1,6 +1,7 @@
 #include "operand_entity.hpp"
 
-#include <regex>
+#include "classifier.hpp"
+#include "names.hpp"
 
 using namespace std;
 
@@ -10,21 +11,49 @@ OperandEntity::OperandEntity(string value) {
 	SetValue(value);
 }
 
-bool OperandEntity::IsValid(string value) {
-	regex pattern("^-{0,1}[A-Za-z_]{1}[A-Za-z0-9_]*$");
-	return value != "inf" && value != "nan" && regex_match(value, pattern);
+OperandEntity::OperandEntity(string value, bool negative) {
+	// the value is already validated by the tokenizer
+	mName = ASTNameTable::Intern(value);
+	SetNegative(negative);
+}
+
+OperandEntity::OperandEntity(unsigned name, bool negative) {
+	mName = name;
+	SetNegative(negative);
+}
+
+bool OperandEntity::IsValid(const string &value) {
+	// ^-{0,1}[A-Za-z_]{1}[A-Za-z0-9_]*$
+	size_t sign = !value.empty() && value[0] == '-';
+	return !ASTClassifier::IsConstant(value) && ASTClassifier::IsIdentifier(value.data() + sign, value.length() - sign);
 }
 
 Entity::EntityType OperandEntity::GetType() {
 	return OPERAND_ENTITY;
 }
 
+unsigned OperandEntity::GetName() {
+	return mName;
+}
+
+string OperandEntity::GetString() {
+	return IsNegative() ? "(-" + GetAbsValue() + ")" : GetAbsValue();
+}
+
+string OperandEntity::GetValue() {
+	return IsNegative() ? "-" + GetAbsValue() : GetAbsValue();
+}
+
+string OperandEntity::GetAbsValue() {
+	return mName == (unsigned)ASTNameTable::INVALID_NAME ? string() : ASTNameTable::GetName(mName);
+}
+
 void OperandEntity::SetValue(string value) {
 	if (IsValid(value)) {
 		if (value[0] == '-') {
-			mValue = value.substr(1);
+			mName = ASTNameTable::Intern(value.data() + 1, value.length() - 1);
 			SetNegative(true);
-		} else mValue = value;
+		} else mName = ASTNameTable::Intern(value);
 	} else {
 		throw ASTValueError("invalid value for operand");
 	}
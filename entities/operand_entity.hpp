@@ -10,8 +10,19 @@ class OperandEntity : public SingleValueEntity {
 public:
 	OperandEntity();
 	OperandEntity(string value);
-	static bool IsValid(string value);
+	OperandEntity(string value, bool negative);
+	// Takes a name already interned, see ASTNameTable.
+	OperandEntity(unsigned name, bool negative);
+	static bool IsValid(const string &value);
 	EntityType GetType() override;
+	// The interned name, see ASTNameTable.
+	unsigned GetName();
+	// -- Value, read back from the name table
+	string GetString() override;
+	string GetValue() override;
+	string GetAbsValue() override;
 	void SetValue(string value) override;
 	~OperandEntity();
+protected:
+	unsigned mName = -1;
 };
\ No newline at end of file
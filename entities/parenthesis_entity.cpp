@@ -22,7 +22,9 @@ int ParenthesisEntity::GetOperatorPrecedence() {
 }
 
 string ParenthesisEntity::GetString() {
-	return (IsNegative() ? "-(" : "(") + mValue->GetString() + ")";
+	string s;
+	WriteString(this, s);
+	return s;
 }
 
 void ParenthesisEntity::Set(Entity *e) {
@@ -33,7 +35,4 @@ void ParenthesisEntity::SetOperator(OperatorType type) {
 	throw ASTException("setting operator on ParenthesisEntity");
 }
 
-ParenthesisEntity::~ParenthesisEntity() {
-	if (mValue != nullptr)
-		delete mValue;
-}
\ No newline at end of file
+ParenthesisEntity::~ParenthesisEntity() {}
\ No newline at end of file
@@ -15,5 +15,5 @@ public:
 	virtual void SetOperator(OperatorType type) override;
 	~ParenthesisEntity();
 private:
-	Entity *mValue;
+	Entity *mValue = nullptr;
 };
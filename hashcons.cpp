@@ -0,0 +1,144 @@
+#include "hashcons.hpp"
+
+#include "names.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+static inline size_t Mix(size_t h, size_t v) {
+	return (h ^ v) * 0x100000001b3ULL + (h >> 29);
+}
+
+static inline size_t Mix(size_t h, const void *p) {
+	return Mix(h, (size_t)(uintptr_t)p);
+}
+
+ASTHashCons::ASTHashCons() : mSlots(64) {}
+
+void ASTHashCons::Clear() {
+	// a huge parse should not make every later one pay for its table
+	if (mSlots.size() > 1024 && mUsed * 8 < mSlots.size())
+		mSlots.assign(1024, Slot());
+	else
+		fill(mSlots.begin(), mSlots.end(), Slot());
+
+	mUsed = 0;
+	mRequests = mHits = 0;
+}
+
+// -- MARK: Nodes
+
+Entity* ASTHashCons::Compound(ASTArena &arena, TieredEntity::OperatorType op, Entity *l, Entity *r) {
+	size_t h = Mix(Mix(Mix(Entity::COMPOUND_ENTITY, (size_t)op), l), r);
+	Entity *e = Find(h, [&](Entity *c) {
+		CompoundEntity *ce = (CompoundEntity*)c;
+		return c->GetType() == Entity::COMPOUND_ENTITY && ce->GetOperator() == op &&
+			ce->Get(CompoundEntity::LEFT_ENTITY) == l && ce->Get(CompoundEntity::RIGHT_ENTITY) == r;
+	});
+
+	return e != nullptr ? e : Add(h, arena.New<CompoundEntity>(op, l, r));
+}
+
+Entity* ASTHashCons::Parenthesis(ASTArena &arena, Entity *inner, bool negative) {
+	size_t h = Mix(Mix(Entity::PARENTHESIS_ENTITY, (size_t)negative), inner);
+	Entity *e = Find(h, [&](Entity *c) {
+		ParenthesisEntity *pe = (ParenthesisEntity*)c;
+		return c->GetType() == Entity::PARENTHESIS_ENTITY && pe->IsNegative() == negative && pe->Get() == inner;
+	});
+
+	return e != nullptr ? e : Add(h, arena.New<ParenthesisEntity>(inner, negative));
+}
+
+Entity* ASTHashCons::Operand(ASTArena &arena, unsigned id, bool negative) {
+	size_t h = Mix(Mix(Entity::OPERAND_ENTITY, (size_t)negative), (size_t)id);
+	Entity *e = Find(h, [&](Entity *c) {
+		OperandEntity *oe = (OperandEntity*)c;
+		return c->GetType() == Entity::OPERAND_ENTITY && oe->IsNegative() == negative && oe->GetName() == id;
+	});
+
+	return e != nullptr ? e : Add(h, arena.New<OperandEntity>(id, negative));
+}
+
+Entity* ASTHashCons::Literal(ASTArena &arena, const string &text, double number, bool negative) {
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(bits));
+
+	size_t h = Mix(Mix(Mix(Entity::LITERAL_ENTITY, (size_t)negative), (size_t)bits), text.length());
+	// the text too, so the tree still prints as it was written
+	Entity *e = Find(h, [&](Entity *c) {
+		LiteralEntity *le = (LiteralEntity*)c;
+		return c->GetType() == Entity::LITERAL_ENTITY && le->IsNegative() == negative && le->GetAbsValue() == text;
+	});
+
+	return e != nullptr ? e : Add(h, arena.New<LiteralEntity>(text, number, negative));
+}
+
+Entity* ASTHashCons::Function(ASTArena &arena, unsigned id, bool negative, Entity *const *args, size_t count) {
+	size_t h = Mix(Mix(Mix(Entity::FUNCTION_ENTITY, (size_t)negative), (size_t)id), count);
+
+	for (size_t i = 0; i < count; i++)
+		h = Mix(h, args[i]);
+
+	Entity *e = Find(h, [&](Entity *c) {
+		FunctionEntity *fe = (FunctionEntity*)c;
+
+		if (c->GetType() != Entity::FUNCTION_ENTITY || fe->IsNegative() != negative ||
+			fe->GetName() != id || fe->GetArgumentsLength() != count)
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+			if (fe->GetArgument(i) != args[i])
+				return false;
+
+		return true;
+	});
+
+	if (e != nullptr)
+		return e;
+
+	FunctionEntity *fe = arena.New<FunctionEntity>(id, negative);
+	fe->ReserveArguments(count, arena);
+	for (size_t i = 0; i < count; i++)
+		fe->AddArgument(args[i]);
+
+	return Add(h, fe);
+}
+
+size_t ASTHashCons::GetRequests() {
+	return mRequests;
+}
+
+size_t ASTHashCons::GetHits() {
+	return mHits;
+}
+
+// -- MARK: Table
+
+Entity* ASTHashCons::Add(size_t hash, Entity *e) {
+	if ((mUsed + 1) * 2 > mSlots.size())
+		Grow();
+
+	const size_t mask = mSlots.size() - 1;
+	size_t i = hash & mask;
+
+	while (mSlots[i].e != nullptr)
+		i = (i + 1) & mask;
+
+	mSlots[i].hash = hash;
+	mSlots[i].e = e;
+	mUsed++;
+	return e;
+}
+
+void ASTHashCons::Grow() {
+	vector<Slot> old(mSlots.size() * 2);
+	old.swap(mSlots);
+	mUsed = 0;
+
+	for (const Slot &s : old)
+		if (s.e != nullptr)
+			Add(s.hash, s.e);
+}
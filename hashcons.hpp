@@ -0,0 +1,56 @@
+#pragma once
+
+#include "arena.hpp"
+#include "entities/entities.hpp"
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Builds a parse as a DAG: a node structurally equal to one already made
+// in the same parse is returned instead of a new one. Children are consed
+// before their parents, so comparing them by pointer is comparing them by
+// structure.
+class ASTHashCons {
+public:
+	ASTHashCons();
+	// Forgets every node; call before each parse.
+	void Clear();
+	Entity* Compound(ASTArena &arena, TieredEntity::OperatorType op, Entity *l, Entity *r);
+	Entity* Parenthesis(ASTArena &arena, Entity *e, bool negative);
+	Entity* Operand(ASTArena &arena, unsigned id, bool negative);
+	Entity* Literal(ASTArena &arena, const string &text, double number, bool negative);
+	Entity* Function(ASTArena &arena, unsigned id, bool negative, Entity *const *args, size_t count);
+	// nodes asked for since the last Clear, and how many already existed
+	size_t GetRequests();
+	size_t GetHits();
+protected:
+	struct Slot {
+		size_t hash;
+		Entity *e;
+	};
+
+	// open addressing, a power of two in size and at most half full
+	vector<Slot> mSlots;
+	size_t mUsed = 0;
+	size_t mRequests = 0, mHits = 0;
+
+	template<typename Equals>
+	Entity* Find(size_t hash, Equals equals) {
+		const size_t mask = mSlots.size() - 1;
+
+		mRequests++;
+		for (size_t i = hash & mask; mSlots[i].e != nullptr; i = (i + 1) & mask) {
+			if (mSlots[i].hash == hash && equals(mSlots[i].e)) {
+				mHits++;
+				return mSlots[i].e;
+			}
+		}
+
+		return nullptr;
+	}
+
+	Entity* Add(size_t hash, Entity *e);
+	void Grow();
+};
@@ -0,0 +1,74 @@
+#include "include.hpp"
+
+#include <climits>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#define AST_STAT_INCLUDES
+#endif
+
+using namespace std;
+
+bool ASTIncludeCache::GetKey(const string &path, ASTIncludeKey &key) {
+#ifdef AST_STAT_INCLUDES
+	char canonical[PATH_MAX];
+	struct stat st;
+
+	if (realpath(path.c_str(), canonical) == nullptr || stat(canonical, &st) != 0 || S_ISDIR(st.st_mode))
+		return false;
+
+	key.path = canonical;
+	key.size = st.st_size;
+#ifdef __APPLE__
+	key.mtime = st.st_mtimespec.tv_sec * 1000000000ll + st.st_mtimespec.tv_nsec;
+#else
+	key.mtime = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+#endif
+	return true;
+#else
+	// nothing to tell two versions apart by, so nothing is ever reused
+	key.path = path;
+	key.size = key.mtime = -1;
+	return true;
+#endif
+}
+
+shared_ptr<ASTInclude> ASTIncludeCache::Find(const ASTIncludeKey &key) {
+	unordered_map<string, shared_ptr<ASTInclude>>::iterator it = mFiles.find(key.path);
+
+	if (it == mFiles.end() || key.size < 0 ||
+		it->second->key.mtime != key.mtime || it->second->key.size != key.size) {
+		mMisses++;
+		return nullptr;
+	}
+
+	mHits++;
+	return it->second;
+}
+
+void ASTIncludeCache::Add(const shared_ptr<ASTInclude> &include) {
+	// a stale version may still be running, it holds on to itself
+	mFiles[include->key.path] = include;
+}
+
+bool ASTIncludeCache::Enter(const string &path, bool once) {
+	if (!mIncluded.insert(path).second && once) {
+		mSkips++;
+		return false;
+	}
+
+	return true;
+}
+
+size_t ASTIncludeCache::GetHits() {
+	return mHits;
+}
+
+size_t ASTIncludeCache::GetMisses() {
+	return mMisses;
+}
+
+size_t ASTIncludeCache::GetSkips() {
+	return mSkips;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "arena.hpp"
+#include "classifier.hpp"
+#include "entities/entities.hpp"
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// Identifies one version of an included file.
+struct ASTIncludeKey {
+	// the canonical path, symbolic links resolved
+	string path;
+	long long mtime = 0;
+	long long size = 0;
+};
+
+// One line of an included file, classified and parsed once.
+struct ASTIncludeEntry {
+	ASTLine::LineType type;
+	// the whole line, for verbose output
+	string text;
+	string key, value;
+	// the expression of SYMBOL_SET_LINE and EXPRESSION_LINE
+	Entity *e = nullptr;
+	// what parsing threw, thrown again when the line runs
+	exception_ptr error;
+};
+
+struct ASTInclude {
+	ASTIncludeKey key;
+	vector<ASTIncludeEntry> entries;
+	// owns every entity of `entries`
+	ASTArena arena;
+};
+
+// Included files by canonical path, each kept as long as it is unchanged
+// on disk, and which files were included at all for include-once.
+class ASTIncludeCache {
+public:
+	// False when `path` does not name a file.
+	static bool GetKey(const string &path, ASTIncludeKey &key);
+	// nullptr when `key` was never added or the file has changed since.
+	shared_ptr<ASTInclude> Find(const ASTIncludeKey &key);
+	void Add(const shared_ptr<ASTInclude> &include);
+	// Records that `path` is included; false, counting a skip, when `once`
+	// is set and it already was.
+	bool Enter(const string &path, bool once);
+	size_t GetHits();
+	size_t GetMisses();
+	size_t GetSkips();
+protected:
+	unordered_map<string, shared_ptr<ASTInclude>> mFiles;
+	unordered_set<string> mIncluded;
+	size_t mHits = 0, mMisses = 0, mSkips = 0;
+};
@@ -1,455 +1,855 @@
 #include "interpreter.hpp"
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <unordered_map>
 #include <cmath>
 
 using namespace std;
 
-ASTInterpreter::ASTInterpreter(bool verbose) : mVerbose(verbose) {
-	mCommentPattern = new regex("^\\s*#(.*)$");
-	mDirectivePattern = new regex("^\\s*@(.*)$");
-	mDirectiveSetPattern = new regex("^\\[\\s*\\$([A-Za-z_]{1}[A-Za-z0-9_]*)\\$\\s*((.*)\\s*){0,1}\\]\\s*$");
-	mDirectiveCallPattern = new regex("^\\[\\s*([A-Za-z_]{1}[A-Za-z0-9_]*)\\s*\\]\\s*$");
-	mDirectiveIncludePattern = new regex("^\\[!(.+)\\]\\s*$");
-	mSymbolSetPattern = new regex("^([A-Za-z_]{1}[A-Za-z0-9_]*)\\s*=\\s*(.*)\\s*$");
-}
-
-void ASTInterpreter::Run(string s, Entity **e) {
-	smatch matches;
-	Entity *tok = nullptr;
-
-	if (regex_match(s, matches, *mDirectivePattern)) {
-		string dir = matches.str(1);
-		if (regex_match(dir, matches, *mDirectiveSetPattern)) {
-			string k = matches.str(1), v = matches.str(3);
-			SetDirective(k, v);
-		} else if (regex_match(dir, matches, *mDirectiveCallPattern)) {
-			string k = matches.str(1);
-			CallDirective(k);
-		} else if (regex_match(dir, matches, *mSymbolSetPattern)) {
-			string k = matches.str(1), v = matches.str(2);
-			// supress the output
-			tok = Parse(v);
-			try {
-				Resolve(tok);
-				SetSymbol(k, PopFromStack());
-				delete tok;
-				tok = nullptr;
-			} catch(const ASTException &ex) {
-				delete tok;
-				throw ex;
-			}
-		} else if (regex_match(dir, matches, *mDirectiveIncludePattern)) {
-			string str = matches.str(1);
-			if (mVerbose)
-				cout << "AST include_file " << str << endl;
+ASTInterpreter::ASTInterpreter(bool verbose) : mVerbose(verbose), mLibrary(make_shared<ASTLibrary>()) {}
 
-			ifstream fp(str);
-			if (!fp.is_open())
-				throw ASTException("cannot open file \"" + str + "\"");
+ASTInterpreter::ASTInterpreter(const shared_ptr<ASTLibrary> &library, bool verbose) :
+	mVerbose(verbose), mLibrary(library) {}
 
-			str.clear();
-
-			while(fp.good())
-			try {
-				string now;
+void ASTInterpreter::Run(const string &s, Entity **e) {
+	Run(s.data(), s.length(), e);
+}
 
-				getline(fp, now, '\n');
+void ASTInterpreter::Run(const char *s, size_t n, Entity **e) {
+	ASTLine line = ASTClassifier::Classify(s, n);
+	Entity *tok = nullptr;
 
-				if (!fp.good() && now.empty())
-					break;
+	// nothing of the previous line is referenced anymore, includes included
+	mArena.Reset();
 
-				if (now.find('\\') == now.length() - 1) {
-					str += now.substr(0, now.length() - 1);
-					continue;
-				} else {
-					str += now;
-				}
+	switch (line.type) {
+	case ASTLine::DIRECTIVE_SET_LINE:
+		SetDirective(string(s + line.key, line.key_length), string(s + line.value, line.value_length));
+		break;
+	case ASTLine::DIRECTIVE_CALL_LINE: {
+		// looked up in place; an unknown name takes the slow path to report it
+		unsigned id = ASTNameTable::Find(s + line.key, line.key_length);
 
-				if (mVerbose)
-					cout << "| running " << str << endl;
+		if (id != (unsigned)ASTNameTable::INVALID_NAME)
+			CallDirective(id);
+		else
+			CallDirective(string(s + line.key, line.key_length));
+		break;
+	}
+	case ASTLine::SYMBOL_SET_LINE:
+		// supress the output
+		Resolve(Parse(s + line.value, line.value_length, mArena));
 
-				Run(str, nullptr);
-				str.clear();
-			} catch (const ASTException &ex) {
-				fp.close();
-				throw ex;
-			}
-		} else {
-			throw ASTSyntaxError("invalid directive syntax");
-		}
-	} else if (!regex_match(s, *mCommentPattern)) {
-		tok = Parse(s);
+		// the key is an identifier already, only "inf" and "nan" are refused
+		if (ASTClassifier::IsConstant(s + line.key, line.key_length))
+			SetSymbol(string(s + line.key, line.key_length), PopFromStack());
+		else
+			SetSymbol(ASTNameTable::Intern(s + line.key, line.key_length), PopFromStack());
+		break;
+	case ASTLine::INCLUDE_LINE:
+	case ASTLine::INCLUDE_ONCE_LINE:
+		Include(string(s + line.value, line.value_length), line.type == ASTLine::INCLUDE_ONCE_LINE);
+		break;
+	case ASTLine::INVALID_DIRECTIVE_LINE:
+		throw ASTSyntaxError("invalid directive syntax");
+	case ASTLine::EXPRESSION_LINE:
+		tok = Parse(s, n, mArena);
 		Resolve(tok);
+		break;
+	case ASTLine::COMMENT_LINE:
+	default:
+		break;
 	}
 
 	if (e != nullptr)
 		*e = tok;
-	else
-		delete tok;
 }
 
-void ASTInterpreter::Resolve(Entity *e) {
-	if (e == nullptr) {
-		throw ASTValueError("cannot resolve null entity");
+// -- MARK: Includes
+
+void ASTInterpreter::Include(const string &path, bool once) {
+	ASTIncludeKey key;
+	shared_ptr<ASTInclude> include;
+
+	if (mVerbose)
+		cout << "AST include_file " << path << endl;
+
+	if (!ASTIncludeCache::GetKey(path, key))
+		throw ASTException("cannot open file \"" + path + "\"");
+
+	if (!mIncludes.Enter(key.path, once)) {
+		if (mVerbose)
+			cout << "AST include_once " << key.path << " skipped" << endl;
 		return;
 	}
 
-	if (mVerbose)
-		cout << "UNR " << GetPostfix(e) << endl;
+	if ((include = mIncludes.Find(key)) == nullptr) {
+		include = LoadInclude(path, key);
+		mIncludes.Add(include);
+	}
 
-	switch(e->GetType()) {
-	case Entity::PARENTHESIS_ENTITY:
-		ResolveParenthesis((ParenthesisEntity*)e);
-		break;
-	case Entity::COMPOUND_ENTITY:
-		ResolveCompound((CompoundEntity*)e);
-		break;
-	case Entity::OPERAND_ENTITY:
-		ResolveOperand((OperandEntity*)e);
-		break;
-	case Entity::LITERAL_ENTITY:
-		ResolveLiteral((LiteralEntity*)e);
-		break;
-	case Entity::FUNCTION_ENTITY:
-		ResolveFunction((FunctionEntity*)e);
-		break;
-	case Entity::INVALID_ENTITY:
-	default:
-		throw ASTTypeError(string("cannot resolve entity ") + e->GetTypeString());
+	// `include` stays alive even if a line replaces it in the cache
+	for (const ASTIncludeEntry &entry : include->entries) {
+		if (mVerbose)
+			cout << "| running " << entry.text << endl;
+
+		RunEntry(entry);
 	}
 }
 
-void ASTInterpreter::ResolveParenthesis(ParenthesisEntity *e) {
-	Resolve(e->Get());
+// Classifies and parses every line up front. What a line fails to parse
+// with is kept for when it runs, so the lines before it run as they did.
+shared_ptr<ASTInclude> ASTInterpreter::LoadInclude(const string &path, const ASTIncludeKey &key) {
+	shared_ptr<ASTInclude> include = make_shared<ASTInclude>();
+	ASTLineReader reader;
+	const char *now;
+	size_t length;
 
-	if (e->IsNegative()) {
-		PushToStack(-PopFromStack());
+	if (!reader.Open(key.path))
+		throw ASTException("cannot open file \"" + path + "\"");
+
+	include->key = key;
+
+	while (reader.Next(now, length)) {
+		ASTLine line = ASTClassifier::Classify(now, length);
+
+		include->entries.push_back(ASTIncludeEntry());
+		ASTIncludeEntry &entry = include->entries.back();
+		entry.type = line.type;
+		entry.text.assign(now, length);
+		entry.key.assign(now + line.key, line.key_length);
+
+		if (line.type == ASTLine::SYMBOL_SET_LINE || line.type == ASTLine::EXPRESSION_LINE) {
+			try {
+				entry.e = Parse(now + line.value, line.value_length, include->arena);
+			} catch (const ASTException&) {
+				entry.error = current_exception();
+			}
+		} else {
+			entry.value.assign(now + line.value, line.value_length);
+		}
 	}
+
+	return include;
 }
 
-void ASTInterpreter::ResolveCompound(CompoundEntity *e) {
-	Entity *l = e->Get(CompoundEntity::LEFT_ENTITY),
-		   *r = e->Get(CompoundEntity::RIGHT_ENTITY);
-	//Entity::EntityType lt = l->GetType(), rt = r->GetType();
-	double ld, rd;
+void ASTInterpreter::RunEntry(const ASTIncludeEntry &entry, Entity **e) {
+	mArena.Reset();
 
-	if (mVerbose)
-		cout << "AST op " << e->GetOperatorString() << endl;
-
-	// The order is reversed to preserve argument ordinality
-	switch(e->GetOperator()) {
-	case TieredEntity::ARITHMETIC_ADD:
-		Resolve(l);
-		ld = PopFromStack();
-		Resolve(r);
-		rd = PopFromStack();
-		PushToStack(ld + rd);
-		break;
-	case TieredEntity::ARITHMETIC_SUB:
-		Resolve(l);
-		ld = PopFromStack();
-		Resolve(r);
-		rd = PopFromStack();
-		PushToStack(ld - rd);
-		break;
-	case TieredEntity::ARITHMETIC_MUL:
-		Resolve(l);
-		ld = PopFromStack();
-		Resolve(r);
-		rd = PopFromStack();
-		PushToStack(ld * rd);
-		break;
-	case TieredEntity::ARITHMETIC_DIV:
-		Resolve(l);
-		ld = PopFromStack();
-		Resolve(r);
-		rd = PopFromStack();
-		PushToStack(ld / rd);
+	// the last parse was another line, its nodes must not be merged with
+	if (mHashConsing)
+		mHashCons.Clear();
+
+	if (entry.error)
+		rethrow_exception(entry.error);
+
+	switch (entry.type) {
+	case ASTLine::DIRECTIVE_SET_LINE:
+		SetDirective(entry.key, entry.value);
 		break;
-	case TieredEntity::ARITHMETIC_MOD:
-		Resolve(l);
-		ld = PopFromStack();
-		Resolve(r);
-		rd = PopFromStack();
-		PushToStack(fmod(ld, rd));
+	case ASTLine::DIRECTIVE_CALL_LINE:
+		CallDirective(entry.key);
 		break;
-	case TieredEntity::ARITHMETIC_POW:
-		// not sure why
-		Resolve(l);
-		ld = PopFromStack();
-		Resolve(r);
-		rd = PopFromStack();
-		PushToStack(pow(ld, rd));
+	case ASTLine::SYMBOL_SET_LINE:
+		Resolve(entry.e);
+		SetSymbol(entry.key, PopFromStack());
 		break;
-	case TieredEntity::OPERATOR_SET:
-		if (l->GetType() == Entity::OPERAND_ENTITY) {
-			Resolve(r);
-			rd = PopFromStack();
-			SetSymbol(l->GetString(), rd);
-			PushToStack(rd);
-			break;
-		} else {
-			throw ASTInvalidOperation("invalid operand for assignment operation");
-			return;
-		}
-		break;
-	/*
-	case TieredEntity::DIRECTIVE_CALL:
-		if (r->GetType() == Entity::FUNCTION_ENTITY) {
-			Resolve(l);
-			Resolve(r);
-		} else {
-			throw ASTInvalidOperation("invalid operand for directive call " + e->GetTypeString());
-			return;
-		}
+	case ASTLine::INCLUDE_LINE:
+	case ASTLine::INCLUDE_ONCE_LINE:
+		Include(entry.value, entry.type == ASTLine::INCLUDE_ONCE_LINE);
 		break;
-	case TieredEntity::DIRECTIVE_ARGS:
-		Resolve(r);
-		Resolve(l);
+	case ASTLine::INVALID_DIRECTIVE_LINE:
+		throw ASTSyntaxError("invalid directive syntax");
+	case ASTLine::EXPRESSION_LINE:
+		Resolve(entry.e);
 		break;
-	*/
+	case ASTLine::COMMENT_LINE:
 	default:
-		throw ASTInvalidOperation(string("invalid operation ") + e->GetOperatorString());
-		return;
+		break;
 	}
 
-	return;
+	if (e != nullptr)
+		*e = entry.type == ASTLine::EXPRESSION_LINE ? entry.e : nullptr;
 }
 
-void ASTInterpreter::ResolveOperand(OperandEntity *e) {
-	double r = GetSymbol(e->GetAbsValue(), e->IsNegative());
+void ASTInterpreter::Resolve(Entity *e) {
+	if (mVerbose && e != nullptr)
+		cout << "UNR " << GetPostfix(e) << endl;
+
+	ASTHashCons *cons = mHashConsing ? &mHashCons : nullptr;
 
-	if (mVerbose)
-		cout << "RES " << r << endl;
+	mCompiler.Compile(mOptimize ? mOptimizer.Optimize(e, mArena, cons) : e, mProgram, mHashConsing, this);
+
+	if (mVerbose && mHashConsing) {
+		cout << "AST dag " << mHashCons.GetRequests() - mHashCons.GetHits() << " node(s), "
+			 << mHashCons.GetHits() << " merged" << endl;
+		cout << "AST cse " << mProgram.reuses << " reuse(s)" << endl;
+	}
 
-	PushToStack(r);
+	Execute(mProgram);
 }
 
-void ASTInterpreter::ResolveLiteral(LiteralEntity *e) {
-	const string v(e->GetAbsValue());
-	istringstream i(v);
-	double r;
+// -- MARK: Execution
 
-	if (!(i >> r))
-		throw ASTValueError("invalid literal \"" + v + "\"");
-	else if (e->IsNegative())
-		r = -r;
+template<typename Trace>
+void ASTInterpreter::Execute(const ASTProgram &p) {
+	const size_t base = mOperands.size();
+	const ASTInstruction *i = p.code.data(), *end = i + p.code.size();
+	double *sp, *locals;
 
-	if (mVerbose)
-		cout << "RES " << r << endl;
+	// calls may grow the operands below this frame, so only offsets are kept
+	mOperands.resize(base + p.depth + p.locals);
+	sp = mOperands.data() + base;
+	locals = sp + p.depth;
+	// what this program pushes itself can skip the capacity checks
+	mStack.Reserve(p.pushes);
 
-	PushToStack(r);
-}
+	try {
+		for (; i != end; ++i) {
+			switch (i->op) {
+			case ASTInstruction::PUSH_LITERAL:
+				if (Trace::enabled)
+					mTracer.Event(ASTTracer::RESULT_EVENT, 0, i->value);
+				*sp++ = i->value;
+				break;
+			case ASTInstruction::LOAD_SYMBOL:
+				*sp = GetSymbol<Trace>(i->name, i->negative, false);
+				if (Trace::enabled)
+					mTracer.Event(ASTTracer::RESULT_EVENT, 0, *sp);
+				sp++;
+				break;
+			case ASTInstruction::STORE_SYMBOL:
+				SetSymbol<Trace>(i->name, sp[-1]);
+				break;
+			case ASTInstruction::ARITHMETIC_ADD:
+			case ASTInstruction::ARITHMETIC_SUB:
+			case ASTInstruction::ARITHMETIC_MUL:
+			case ASTInstruction::ARITHMETIC_DIV:
+			case ASTInstruction::ARITHMETIC_MOD:
+			case ASTInstruction::ARITHMETIC_POW: {
+				double rd = *--sp, &ld = sp[-1];
+
+				if (Trace::enabled)
+					mTracer.Event(ASTTracer::OPERATION_EVENT, i->op);
+
+				ld = ASTCompiler::Apply(i->op, ld, rd);
+				break;
+			}
+			case ASTInstruction::NEGATE:
+				sp[-1] = -sp[-1];
+				break;
+			case ASTInstruction::CALL_DIRECTIVE: {
+				const size_t top = (sp - mOperands.data()) - i->argc;
+				ASTCallSite &site = p.sites[i->site];
+				ASTMemo *memo = nullptr;
+				double r;
+
+				if (site.version != GetDirectiveVersion(i->name))
+					ResolveCallSite(site, i->name);
+
+				if (mMemoize && site.builtin == ASTCallSite::NO_BUILTIN && site.directive != nullptr &&
+					site.directive->body != nullptr && site.directive->program.effects.pops == i->argc) {
+					CheckPurity(site.directive);
+					if (site.directive->closed)
+						memo = &GetMemo(i->name);
+				}
 
-void ASTInterpreter::ResolveFunction(FunctionEntity* e) {
-	vector<Entity*> raw_args = e->GetArguments();
-	vector<double> args;
-	for (vector<Entity*>::iterator it = raw_args.begin(); it != raw_args.end(); ++it) {
-		Resolve(*it);
-		args.push_back(PopFromStack());
-	}
+				if (memo != nullptr && memo->Find(sp - i->argc, i->argc, r)) {
+					if (Trace::enabled)
+						mTracer.Event(ASTTracer::MEMO_HIT_EVENT, i->name);
+
+					sp -= i->argc;
+					if (i->negative)
+						r = -r;
+					if (i->keep)
+						PushToStackUnchecked<Trace>(r);
+					else
+						*sp++ = r;
+					break;
+				}
 
-	if (mVerbose)
-		cout << "AST function_stack_push" << endl;
+				if (Trace::enabled)
+					mTracer.Event(ASTTracer::FRAME_EVENT);
+
+				// the first argument ends up on top
+				for (long a = 1; a <= (long)i->argc; a++)
+					PushToStackUnchecked<Trace>(sp[-a]);
+				sp -= i->argc;
 
-	for (vector<double>::reverse_iterator it = args.rbegin(); it != args.rend(); ++it) {
-		PushToStack(*it);
+				CallDirective<Trace>(i->name, i->negative, false, &site);
+
+				// the arguments are still there, above the frame's own values
+				sp = mOperands.data() + top;
+				locals = mOperands.data() + base + p.depth;
+				// the call may have left more than it took
+				mStack.Reserve(p.pushes);
+				if (memo != nullptr) {
+					r = mStack.Top();
+					memo->Add(sp, i->argc, i->negative ? -r : r);
+				}
+				if (i->keep)
+					break;
+				// a builtin leaves nothing, a directive may not through a call of one
+				if (site.builtin == ASTCallSite::NO_BUILTIN && site.directive->program.returns)
+					*sp++ = PopFromStackUnchecked<Trace>();
+				else
+					*sp++ = PopFromStack<Trace>();
+				break;
+			}
+			case ASTInstruction::STORE_LOCAL:
+				locals[i->name] = sp[-1];
+				break;
+			case ASTInstruction::LOAD_LOCAL:
+				*sp++ = locals[i->name];
+				if (Trace::enabled)
+					mTracer.Event(ASTTracer::RESULT_EVENT, 0, sp[-1]);
+				break;
+			case ASTInstruction::RETURN_VALUE:
+				PushToStackUnchecked<Trace>(*--sp);
+				break;
+			case ASTInstruction::RAISE_VALUE_ERROR:
+				throw ASTValueError(p.names[i->name]);
+			case ASTInstruction::RAISE_TYPE_ERROR:
+				throw ASTTypeError(p.names[i->name]);
+			case ASTInstruction::RAISE_INVALID_OPERATION:
+			default:
+				throw ASTInvalidOperation(p.names[i->name]);
+			}
+		}
+	} catch (...) {
+		mOperands.resize(base);
+		throw;
 	}
 
-	CallDirective(e->GetAbsValue(), e->IsNegative());
+	mOperands.resize(base);
 }
 
-bool ASTInterpreter::SymbolExists(string k) {
-	bool r = false;
+// Picks the evaluator once per program, calls stay in the same one.
+void ASTInterpreter::Execute(const ASTProgram &p) {
+	if (IsTracing())
+		Execute<ASTTracing>(p);
+	else
+		Execute<ASTNoTracing>(p);
+}
 
-	try {
-		mSymbols.at(k);
-		r = true;
-	} catch (const out_of_range &ex) {
-		//. pass?
-		r = false;
-	}
+// -- MARK: Symbols
 
-	return r;
+bool ASTInterpreter::SymbolExists(const string &k) {
+	unsigned id = ASTNameTable::Find(k);
+	return id != (unsigned)ASTNameTable::INVALID_NAME && SymbolExists(id);
 }
 
-void ASTInterpreter::SetSymbol(string k, double v) {
-	if (mVerbose)
-		cout << "AST set_symbol " << k << "=" << v << endl;
+bool ASTInterpreter::SymbolExists(unsigned id) {
+	return (id < mSymbols.size() && mSymbols[id].defined) || mLibrary->GetSymbol(id) != nullptr;
+}
 
-	if (!OperandEntity::IsValid(k))
+void ASTInterpreter::SetSymbol(const string &k, double v) {
+	if (!OperandEntity::IsValid(k)) {
+		if (mVerbose)
+			cout << "AST set_symbol " << k << "=" << v << endl;
 		throw ASTValueError("invalid symbol name");
-	else if (k == "_")
-		PushToStack(v);
-	else if (k == "__")
-		throw new ASTInvalidOperation("assignment to a reserved symbol");
+	}
+
+	SetSymbol(ASTNameTable::Intern(k), v);
+}
+
+void ASTInterpreter::SetSymbol(unsigned id, double v) {
+	if (IsTracing())
+		SetSymbol<ASTTracing>(id, v);
 	else
-		mSymbols[k] = v;
+		SetSymbol<ASTNoTracing>(id, v);
 }
 
-double ASTInterpreter::GetSymbol(string k, bool negative, bool ignore_error) {
-	double ret = 0;
+template<typename Trace>
+void ASTInterpreter::SetSymbol(unsigned id, double v) {
+	if (Trace::enabled)
+		mTracer.Event(ASTTracer::SET_SYMBOL_EVENT, id, v);
+
+	if (id == ASTNameTable::STACK_TOP_NAME) {
+		PushToStack<Trace>(v);
+	} else if (id == ASTNameTable::STACK_SIZE_NAME) {
+		throw ASTInvalidOperation("assignment to a reserved symbol");
+	} else {
+		if (id >= mSymbols.size())
+			mSymbols.resize(ASTNameTable::GetLength());
+
+		mSymbols[id].value = v;
+		mSymbols[id].defined = true;
+	}
+}
+
+double ASTInterpreter::GetSymbol(const string &k, bool negative, bool ignore_error) {
+	unsigned id = ASTNameTable::Find(k);
+
+	if (id != (unsigned)ASTNameTable::INVALID_NAME)
+		return GetSymbol(id, negative, ignore_error);
 
 	if (mVerbose)
 		cout << "AST get_symbol " << k << endl;
 
-	if (k == "_")
-		ret = PopFromStack();
-	else if (k == "__")
-		ret = mStack.size();
-	else if (SymbolExists(k))
-		ret = mSymbols[k];
-	else if (!ignore_error)
+	if (!ignore_error)
 		throw ASTNotFound("cannot find symbol " + k);
 
+	return 0;
+}
+
+double ASTInterpreter::GetSymbol(unsigned id, bool negative, bool ignore_error) {
+	if (IsTracing())
+		return GetSymbol<ASTTracing>(id, negative, ignore_error);
+	return GetSymbol<ASTNoTracing>(id, negative, ignore_error);
+}
+
+template<typename Trace>
+double ASTInterpreter::GetSymbol(unsigned id, bool negative, bool ignore_error) {
+	double ret = 0;
+
+	if (Trace::enabled)
+		mTracer.Event(ASTTracer::GET_SYMBOL_EVENT, id);
+
+	if (id == ASTNameTable::STACK_TOP_NAME)
+		ret = PopFromStack<Trace>();
+	else if (id == ASTNameTable::STACK_SIZE_NAME)
+		ret = mStack.GetLength();
+	else if (id < mSymbols.size() && mSymbols[id].defined)
+		ret = mSymbols[id].value;
+	else if (const ASTSymbol *global = mLibrary->GetSymbol(id))
+		ret = global->value;
+	else if (!ignore_error)
+		throw ASTNotFound("cannot find symbol " + ASTNameTable::GetName(id));
+
 	if (negative)
 		ret = -ret;
 
 	return ret;
 }
 
-bool ASTInterpreter::DirectiveExists(string k) {
-	if (k == "_" || k == "__" ||
-		k == "__cmp_eq__" || k == "__cmp_neq__" ||
-		k == "__cmp_lt__" || k == "__cmp_lte__" ||
-		k == "__cmp_gt__" || k == "__cmp_gte__")
-		return true;
+// -- MARK: Directives
 
-	try {
-		mDirectives.at(k);
-		return true;
-	} catch (const out_of_range &ex) {
-		//. pass?
-	}
+bool ASTInterpreter::DirectiveExists(const string &k) {
+	unsigned id = ASTNameTable::Find(k);
+	return id != (unsigned)ASTNameTable::INVALID_NAME && DirectiveExists(id);
+}
 
-	return false;
+bool ASTInterpreter::DirectiveExists(unsigned id) {
+	ASTCallSite site;
+	ResolveCallSite(site, id);
+	return site.builtin != ASTCallSite::NO_BUILTIN || site.directive != nullptr;
 }
 
-void ASTInterpreter::SetDirective(string k, string v) {
+void ASTInterpreter::SetDirective(const string &k, const string &v) {
 	if (mVerbose)
 		cout << "AST set_directive " << k << "=" << v << endl;
 
-	if (!regex_match(k, regex("^[A-Za-z_]{1}[A-Za-z0-9_]*$"))) {
+	if (!ASTClassifier::IsIdentifier(k))
 		throw ASTNotFound("invalid directive name " + k);
-	} else if (k == "__cmp_eq__" || k == "__cmp_neq__" ||
-				k == "__cmp_lt__" || k == "__cmp_lte__" ||
-				k == "__cmp_gt__" || k == "__cmp_gte__") {
+
+	unsigned id = ASTNameTable::Intern(k);
+	if (ASTCallSite::GetBuiltin(id) != ASTCallSite::NO_BUILTIN)
 		throw ASTInvalidOperation("assignment to a reserved directive");
-	}
+	else if (mLibrary->IsFrozen())
+		throw ASTInvalidOperation("assignment to a directive of a shared library");
 
-	Entity *p = nullptr;
-	if (!v.empty())
-		p = Parse(v);
+	ASTDirective *d = new ASTDirective();
+	try {
+		if (!v.empty()) {
+			ASTHashCons *cons = mHashConsing ? &mHashCons : nullptr;
 
-	if (DirectiveExists(k) && mDirectives[k] != nullptr)
-		delete mDirectives[k];
+			d->body = Parse(v, d->arena);
+			// what the body calls may be redefined before it runs
+			mCompiler.Compile(mOptimize ? mOptimizer.Optimize(d->body, d->arena, cons) : d->body,
+				d->program, mHashConsing);
+		}
+	} catch (...) {
+		delete d;
+		throw;
+	}
 
-	mDirectives[k] = p;
+	mLibrary->SetDirective(id, d);
 }
 
-void ASTInterpreter::CallDirective(string k, bool negative, bool ignore_error) {
+void ASTInterpreter::CallDirective(const string &k, bool negative, bool ignore_error) {
+	unsigned id = ASTNameTable::Find(k);
+
+	if (id != (unsigned)ASTNameTable::INVALID_NAME) {
+		CallDirective(id, negative, ignore_error);
+		return;
+	}
+
 	if (mVerbose)
 		cout << "AST call_directive " << k << endl;
 
-	if (k == "__cmp_eq__") {
-		if (!SymbolExists("_1") || !SymbolExists("_2") || !SymbolExists("_3") || !SymbolExists("_4"))
-			throw ASTInvalidOperation("directive required symbols do not exists");
-		else
-			SetSymbol("_1", (GetSymbol("_1") == GetSymbol("_2") ? GetSymbol("_3") : GetSymbol("_4")));
-	} else if (k == "__cmp_neq__") {
-		if (!SymbolExists("_1") || !SymbolExists("_2") || !SymbolExists("_3") || !SymbolExists("_4"))
-			throw ASTInvalidOperation("directive required symbols do not exists");
-		else
-			SetSymbol("_1", (GetSymbol("_1") != GetSymbol("_2") ? GetSymbol("_3") : GetSymbol("_4")));
-	} else if (k == "__cmp_lt__") {
-		if (!SymbolExists("_1") || !SymbolExists("_2") || !SymbolExists("_3") || !SymbolExists("_4"))
-			throw ASTInvalidOperation("directive required symbols do not exists");
-		else
-			SetSymbol("_1", (GetSymbol("_1") < GetSymbol("_2") ? GetSymbol("_3") : GetSymbol("_4")));
-	} else if (k == "__cmp_lte__") {
-		if (!SymbolExists("_1") || !SymbolExists("_2") || !SymbolExists("_3") || !SymbolExists("_4"))
-			throw ASTInvalidOperation("directive required symbols do not exists");
-		else
-			SetSymbol("_1", (GetSymbol("_1") <= GetSymbol("_2") ? GetSymbol("_3") : GetSymbol("_4")));
-	} else if (k == "__cmp_gt__") {
-		if (!SymbolExists("_1") || !SymbolExists("_2") || !SymbolExists("_3") || !SymbolExists("_4"))
-			throw ASTInvalidOperation("directive required symbols do not exists");
-		else
-			SetSymbol("_1", (GetSymbol("_1") > GetSymbol("_2") ? GetSymbol("_3") : GetSymbol("_4")));
-	} else if (k == "__cmp_gte__") {
-		if (!SymbolExists("_1") || !SymbolExists("_2") || !SymbolExists("_3") || !SymbolExists("_4"))
-			throw ASTInvalidOperation("directive required symbols do not exists");
-		else
-			SetSymbol("_1", (GetSymbol("_1") >= GetSymbol("_2") ? GetSymbol("_3") : GetSymbol("_4")));
-	} else if (DirectiveExists(k)) {
-		if (mDirectives[k] == nullptr) {
-			throw ASTInvalidOperation("cannot call null directive " + k);
+	if (!ignore_error)
+		throw ASTNotFound("cannot find directive " + k);
+
+	if (negative) {
+		PushToStack(-PopFromStack());
+	}
+}
+
+void ASTInterpreter::CallDirective(unsigned id, bool negative, bool ignore_error, ASTCallSite *site) {
+	if (IsTracing())
+		CallDirective<ASTTracing>(id, negative, ignore_error, site);
+	else
+		CallDirective<ASTNoTracing>(id, negative, ignore_error, site);
+}
+
+template<typename Trace>
+void ASTInterpreter::CallDirective(unsigned id, bool negative, bool ignore_error, ASTCallSite *site) {
+	ASTCallSite resolved;
+
+	if (Trace::enabled)
+		mTracer.Event(ASTTracer::CALL_EVENT, id);
+
+	if (site == nullptr) {
+		ResolveCallSite(resolved, id);
+		site = &resolved;
+	} else if (site->version != GetDirectiveVersion(id)) {
+		ResolveCallSite(*site, id);
+	}
+
+	switch (site->builtin) {
+	case ASTCallSite::NO_BUILTIN:
+		if (site->directive == nullptr) {
+			if (!ignore_error)
+				throw ASTNotFound("cannot find directive " + ASTNameTable::GetName(id));
+		} else if (site->directive->body == nullptr) {
+			throw ASTInvalidOperation("cannot call null directive " + ASTNameTable::GetName(id));
 		} else {
-			Resolve(mDirectives[k]);
-			if (mVerbose) {
-				double r = PopFromStack();
-				cout << "RES " << r << endl;
-				PushToStack(r);
+			// only bodies that run are profiled, not failed lookups or builtins
+			ASTProfileScope scope(Trace::enabled ? mProfiler.get() : nullptr, id);
+
+			if (Trace::enabled && mVerbose)
+				cout << "UNR " << GetPostfix(site->directive->body) << endl;
+			if (Trace::enabled || !RunCompiled(id, site->directive))
+				Execute<Trace>(site->directive->program);
+			if (Trace::enabled) {
+				double r = PopFromStack<Trace>();
+				mTracer.Event(ASTTracer::RESULT_EVENT, 0, r);
+				PushToStack<Trace>(r);
 			}
 		}
-	} else if (!ignore_error) {
-		throw ASTNotFound("cannot find directive " + k);
+		break;
+	case ASTCallSite::NULL_BUILTIN:
+		throw ASTInvalidOperation("cannot call null directive " + ASTNameTable::GetName(id));
+	default:
+		CallBuiltin(site->builtin);
+		break;
 	}
 
 	if (negative) {
-		PushToStack(-PopFromStack());
+		PushToStack<Trace>(-PopFromStack<Trace>());
 	}
 }
 
+bool ASTInterpreter::IsPureCall(unsigned id, unsigned argc) {
+	ASTDirective *d = mLibrary->GetDirective(id);
+
+	// the builtins assign `_1`
+	if (d == nullptr || d->body == nullptr || ASTCallSite::GetBuiltin(id) != ASTCallSite::NO_BUILTIN)
+		return false;
+
+	CheckPurity(d);
+	return d->pure && d->program.effects.pops == argc;
+}
+
+void ASTInterpreter::CheckPurity(ASTDirective *d) {
+	// always the case once the library is frozen, nothing is written then
+	if (d->epoch == mLibrary->GetEpoch())
+		return;
+
+	// a directive reached again while checking it recurses: never pure
+	d->epoch = mLibrary->GetEpoch();
+	d->pure = d->closed = false;
+
+	const ASTProgram &p = d->program;
+	bool pure = !p.effects.stores && !p.effects.reads_stack_size;
+	bool closed = pure && !p.effects.reads_symbols;
+
+	for (size_t i = 0; pure && i < p.code.size(); i++) {
+		const ASTInstruction &c = p.code[i];
+
+		if (c.op != ASTInstruction::CALL_DIRECTIVE)
+			continue;
+		else if (!IsPureCall(c.name, c.argc))
+			pure = closed = false;
+		else if (!mLibrary->GetDirective(c.name)->closed)
+			closed = false;
+	}
+
+	d->pure = pure;
+	d->closed = closed;
+}
+
+void ASTInterpreter::CallBuiltin(ASTCallSite::BuiltinType builtin) {
+	static const unsigned a = ASTNameTable::Intern("_1"), b = ASTNameTable::Intern("_2"),
+						  t = ASTNameTable::Intern("_3"), f = ASTNameTable::Intern("_4");
+	bool r = false;
+
+	if (!SymbolExists(a) || !SymbolExists(b) || !SymbolExists(t) || !SymbolExists(f))
+		throw ASTInvalidOperation("directive required symbols do not exists");
+
+	double l = GetSymbol(a), rd = GetSymbol(b);
+
+	switch (builtin) {
+	case ASTCallSite::CMP_EQ_BUILTIN:
+		r = l == rd;
+		break;
+	case ASTCallSite::CMP_NEQ_BUILTIN:
+		r = l != rd;
+		break;
+	case ASTCallSite::CMP_LT_BUILTIN:
+		r = l < rd;
+		break;
+	case ASTCallSite::CMP_LTE_BUILTIN:
+		r = l <= rd;
+		break;
+	case ASTCallSite::CMP_GT_BUILTIN:
+		r = l > rd;
+		break;
+	case ASTCallSite::CMP_GTE_BUILTIN:
+		r = l >= rd;
+		break;
+	default:
+		break;
+	}
+
+	SetSymbol(a, r ? GetSymbol(t) : GetSymbol(f));
+}
+
+unsigned ASTInterpreter::GetDirectiveVersion(unsigned id) {
+	return mLibrary->GetVersion(id);
+}
+
+void ASTInterpreter::ResolveCallSite(ASTCallSite &site, unsigned id) {
+	site.builtin = ASTCallSite::GetBuiltin(id);
+	site.directive = mLibrary->GetDirective(id);
+	site.version = GetDirectiveVersion(id);
+
+	if (site.builtin == ASTCallSite::NO_BUILTIN && site.directive == nullptr &&
+		(id == ASTNameTable::STACK_TOP_NAME || id == ASTNameTable::STACK_SIZE_NAME))
+		site.builtin = ASTCallSite::NULL_BUILTIN;
+}
+
+void ASTInterpreter::SetOptimize(bool optimize) {
+	mOptimize = optimize;
+}
+
+bool ASTInterpreter::GetOptimize() {
+	return mOptimize;
+}
+
+void ASTInterpreter::SetMemoize(bool memoize) {
+	mMemoize = memoize;
+}
+
+bool ASTInterpreter::GetMemoize() {
+	return mMemoize;
+}
+
+ASTMemo* ASTInterpreter::GetMemo(const string &k) {
+	unsigned id = ASTNameTable::Find(k);
+	return GetDirective(id) != nullptr ? &GetMemo(id) : nullptr;
+}
+
+// What a directive gave under the current epoch; a directive it calls
+// may have been redefined since the previous one.
+ASTMemo& ASTInterpreter::GetMemo(unsigned id) {
+	if (id >= mMemos.size())
+		mMemos.resize(mLibrary->GetLength());
+
+	ASTMemoSlot &slot = mMemos[id];
+	if (slot.first == 0)
+		slot.first = ++mMemosUsed;
+	if (slot.epoch != mLibrary->GetEpoch()) {
+		slot.memo.Clear();
+		slot.epoch = mLibrary->GetEpoch();
+	}
+
+	return slot.memo;
+}
+
+void ASTInterpreter::SetJitThreshold(unsigned calls) {
+	mJitThreshold = calls;
+}
+
+unsigned ASTInterpreter::GetJitThreshold() {
+	return mJitThreshold;
+}
+
+const ASTJitCode* ASTInterpreter::GetJitCode(const string &k) {
+	unsigned id = ASTNameTable::Find(k);
+
+	if (id >= mJits.size() || mJits[id].version != GetDirectiveVersion(id))
+		return nullptr;
+	return mJits[id].code.get();
+}
+
+// Runs the machine code of `d`, compiling it once it is hot enough. False
+// when the VM has to run the body instead: not compiled (yet), too few
+// arguments for the error to be raised here, or a symbol the code reads
+// is not assigned in this interpreter.
+bool ASTInterpreter::RunCompiled(unsigned id, const ASTDirective *d) {
+	if (mJitThreshold == 0)
+		return false;
+	if (id >= mJits.size())
+		mJits.resize(mLibrary->GetLength());
+
+	ASTJitSlot &slot = mJits[id];
+	if (slot.version != GetDirectiveVersion(id)) {
+		slot.code.reset();
+		slot.version = GetDirectiveVersion(id);
+		slot.calls = 0;
+		slot.tried = false;
+	}
+
+	if (slot.code == nullptr) {
+		if (slot.tried || ++slot.calls < mJitThreshold)
+			return false;
+
+		slot.tried = true;
+		slot.code = ASTJit::Compile(d->program);
+		if (slot.code == nullptr)
+			return false;
+	}
+
+	const ASTJitCode &code = *slot.code;
+	double r;
+
+	if (mStack.GetLength() < code.GetPops())
+		return false;
+	if (mSymbols.size() < code.GetSymbolsLength())
+		mSymbols.resize(ASTNameTable::GetLength());
+	if (!code.Run(mStack.Peek(code.GetPops()), mSymbols.data(), r))
+		return false;
+
+	mStack.Drop(code.GetPops());
+	mStack.Push(r);
+	return true;
+}
+
+ASTDirective* ASTInterpreter::GetDirective(unsigned id) {
+	return mLibrary->GetDirective(id);
+}
+
+shared_ptr<ASTLibrary> ASTInterpreter::Share() {
+	if (!mLibrary->IsFrozen()) {
+		mLibrary->SetSymbols(mSymbols);
+
+		// work out now everything that would otherwise be cached on first use
+		for (size_t id = 0; id < mLibrary->GetLength(); id++) {
+			ASTDirective *d = mLibrary->GetDirective(id);
+			if (d == nullptr)
+				continue;
+
+			CheckPurity(d);
+			for (const ASTInstruction &i : d->program.code)
+				if (i.op == ASTInstruction::CALL_DIRECTIVE)
+					ResolveCallSite(d->program.sites[i.site], i.name);
+		}
+
+		mLibrary->Freeze();
+	}
+
+	return mLibrary;
+}
+
 void ASTInterpreter::SetVerbose(bool verbose) {
 	mVerbose = verbose;
+	mTracer.SetVerbose(verbose);
 }
 
 bool ASTInterpreter::GetVerbose() {
 	return mVerbose;
 }
 
+void ASTInterpreter::SetTraceSink(const shared_ptr<ASTTraceSink> &sink) {
+	mTracer.SetSink(sink);
+}
+
+void ASTInterpreter::SetProfiling(bool profiling) {
+	if (!profiling)
+		mProfiler.reset();
+	else if (mProfiler == nullptr)
+		mProfiler.reset(new ASTProfiler());
+}
+
+ASTProfiler* ASTInterpreter::GetProfiler() {
+	return mProfiler.get();
+}
+
+bool ASTInterpreter::IsTracing() {
+	return mTracer.IsEnabled() || mProfiler != nullptr;
+}
+
 bool ASTInterpreter::IsStackEmpty() {
-	return mStack.empty();
+	return mStack.IsEmpty();
 }
 
+double ASTInterpreter::PopFromStack() {
+	if (IsTracing())
+		return PopFromStack<ASTTracing>();
+	return PopFromStack<ASTNoTracing>();
+}
+
+template<typename Trace>
 double ASTInterpreter::PopFromStack() {
 	if (IsStackEmpty()) {
 		throw ASTInvalidOperation("stack is empty");
 	}
 
-	double d = mStack.top();
-	if (mVerbose)
-		cout << "AST stack_pop " << d << endl;
+	return PopFromStackUnchecked<Trace>();
+}
 
-	mStack.pop();
+template<typename Trace>
+double ASTInterpreter::PopFromStackUnchecked() {
+	double d = mStack.Pop();
+	if (Trace::enabled)
+		mTracer.Event(ASTTracer::STACK_POP_EVENT, 0, d);
 	return d;
 }
 
 void ASTInterpreter::PushToStack(double v) {
-	if (mVerbose)
-		cout << "AST stack_push " << v << endl;
-	mStack.push(v);
+	if (IsTracing())
+		PushToStack<ASTTracing>(v);
+	else
+		PushToStack<ASTNoTracing>(v);
+}
+
+template<typename Trace>
+void ASTInterpreter::PushToStack(double v) {
+	if (Trace::enabled)
+		mTracer.Event(ASTTracer::STACK_PUSH_EVENT, 0, v);
+	mStack.Push(v);
+}
+
+template<typename Trace>
+void ASTInterpreter::PushToStackUnchecked(double v) {
+	if (Trace::enabled)
+		mTracer.Event(ASTTracer::STACK_PUSH_EVENT, 0, v);
+	mStack.PushUnchecked(v);
 }
 
 ASTInterpreter::~ASTInterpreter() {
-	delete mDirectivePattern;
-	delete mDirectiveSetPattern;
-	delete mDirectiveCallPattern;
-	delete mDirectiveIncludePattern;
-	delete mSymbolSetPattern;
-
-	// free all directives
-	for (unordered_map<string, Entity*>::iterator it = mDirectives.begin(); it != mDirectives.end(); ++it) {
-		if (it->second != nullptr)
-			delete it->second;
+	vector<unsigned> used(mMemosUsed, -1);
+
+	for (size_t id = 0; id < mMemos.size(); id++) {
+		if (mMemos[id].first > 0)
+			used[mMemos[id].first - 1] = id;
 	}
 
+	for (unsigned id : used) {
+		ASTMemo &memo = mMemos[id].memo;
+
+		if (mVerbose && memo.GetHits() + memo.GetMisses() > 0)
+			cout << "AST memo " << ASTNameTable::GetName(id) << " "
+				 << memo.GetHits() << " hit(s), " << memo.GetMisses() << " miss(es)" << endl;
+	}
+
+	if (mVerbose && mIncludes.GetHits() + mIncludes.GetMisses() > 0)
+		cout << "AST include_cache " << mIncludes.GetHits() << " hit(s), " << mIncludes.GetMisses() << " miss(es), "
+			 << mIncludes.GetSkips() << " skip(s)" << endl;
+
 	if (mVerbose) {
-		cout << "AST destroyed with " << mStack.size() << " item(s) on the stack" << endl;
+		cout << "AST destroyed with " << mStack.GetLength() << " item(s) on the stack" << endl;
 	}
 }
@@ -1,41 +1,154 @@
 #pragma once
 
+#include "classifier.hpp"
+#include "compiler.hpp"
+#include "include.hpp"
+#include "jit.hpp"
 #include "lexical.hpp"
+#include "library.hpp"
+#include "memo.hpp"
+#include "names.hpp"
+#include "optimizer.hpp"
+#include "profile.hpp"
+#include "reader.hpp"
+#include "stack.hpp"
+#include "trace.hpp"
 
-#include <stack>
+#include <memory>
 #include <unordered_map>
-#include <regex>
 
 using namespace std;
 
-class ASTInterpreter : public ASTLex {
+// The results of one directive, valid while `epoch` is the library's.
+struct ASTMemoSlot {
+	ASTMemo memo;
+	unsigned epoch = -1;
+	// when the directive was first memoized, from 1; the verbose report is
+	// in this order, which does not depend on when names were interned
+	size_t first = 0;
+};
+
+// The machine code of one directive, valid while `version` is its slot's.
+struct ASTJitSlot {
+	unique_ptr<ASTJitCode> code;
+	unsigned version = -1;
+	unsigned calls = 0;
+	// compiled once per version, even when the body cannot be
+	bool tried = false;
+};
+
+// One evaluation context: the stack, the symbols assigned through it and
+// every buffer of parsing and execution, over a library of directives and
+// global symbols. Interpreters sharing a frozen library are independent
+// and may run on different threads.
+class ASTInterpreter : public ASTLex, public ASTCallOracle {
 public:
 	ASTInterpreter(bool verbose=false);
-	void Run(string s, Entity **e = nullptr);
+	// Evaluates against `library`, frozen by the Share of another interpreter.
+	ASTInterpreter(const shared_ptr<ASTLibrary> &library, bool verbose=false);
+	// The entity handed back through `e` lives until the next Run.
+	void Run(const string &s, Entity **e = nullptr);
+	// Runs a line in place, `s` only has to outlive the call.
+	void Run(const char *s, size_t n, Entity **e = nullptr);
+	// Runs a line classified and parsed ahead, by an include or an
+	// ASTPipeline, as Run would have run its text.
+	void RunEntry(const ASTIncludeEntry &entry, Entity **e = nullptr);
+	// Runs every line of a file, parsed once and reused until the file
+	// changes; with `once`, only if it was never included before.
+	void Include(const string &path, bool once=false);
 	void Resolve(Entity *e);
-	void ResolveParenthesis(ParenthesisEntity *e);
-	void ResolveCompound(CompoundEntity *e);
-	void ResolveOperand(OperandEntity *e);
-	void ResolveLiteral(LiteralEntity *e);
-	void ResolveFunction(FunctionEntity* e);
-	bool SymbolExists(string k);
-	void SetSymbol(string k, double v);
-	double GetSymbol(string k, bool negative=false, bool ignore_error=false);
-	bool DirectiveExists(string k);
-	void SetDirective(string k, string v);
-	void CallDirective(string k, bool negative=false, bool ignore_error=false);
+	void Execute(const ASTProgram &p);
+	bool SymbolExists(const string &k);
+	bool SymbolExists(unsigned id);
+	void SetSymbol(const string &k, double v);
+	void SetSymbol(unsigned id, double v);
+	double GetSymbol(const string &k, bool negative=false, bool ignore_error=false);
+	double GetSymbol(unsigned id, bool negative=false, bool ignore_error=false);
+	bool DirectiveExists(const string &k);
+	bool DirectiveExists(unsigned id);
+	void SetDirective(const string &k, const string &v);
+	void CallDirective(const string &k, bool negative=false, bool ignore_error=false);
+	// `site` caches the resolved target across calls from the same place
+	void CallDirective(unsigned id, bool negative=false, bool ignore_error=false, ASTCallSite *site=nullptr);
+	// A call of a directive that assigns nothing, leaves `__` alone, pops
+	// exactly its `argc` arguments and only calls directives like itself.
+	bool IsPureCall(unsigned id, unsigned argc) override;
+	// Calls of directives reading nothing but their arguments are answered
+	// from a table of earlier results; on by default.
+	void SetMemoize(bool memoize);
+	bool GetMemoize();
+	// nullptr when `k` is not a defined directive
+	ASTMemo* GetMemo(const string &k);
+	// Compiles a directive to machine code (see ASTJit) once it was called
+	// `calls` times, and runs that instead from then on; 0, the default,
+	// keeps everything in the VM. Not used while tracing or profiling.
+	void SetJitThreshold(unsigned calls);
+	unsigned GetJitThreshold();
+	// nullptr until `k` was compiled
+	const ASTJitCode* GetJitCode(const string &k);
+	ASTDirective* GetDirective(unsigned id);
+	// Freezes the library with the directives set so far and the symbols
+	// as they are now, for other interpreters to share. Directives can no
+	// longer be set afterwards; symbols can, in this interpreter only.
+	shared_ptr<ASTLibrary> Share();
+	// Applies only to what is compiled afterwards.
+	void SetOptimize(bool optimize);
+	bool GetOptimize();
 	void SetVerbose(bool verbose);
 	bool GetVerbose();
+	// Writes every evaluation event to `sink` as well, nullptr to stop.
+	void SetTraceSink(const shared_ptr<ASTTraceSink> &sink);
+	// Times every directive call from now on, through the traced evaluator;
+	// turning it off drops what was recorded.
+	void SetProfiling(bool profiling);
+	// nullptr unless profiling
+	ASTProfiler* GetProfiler();
 	bool IsStackEmpty();
 	double PopFromStack();
 	void PushToStack(double v);
 	~ASTInterpreter();
 protected:
 	bool mVerbose = false;
-	stack<double> mStack;
-	unordered_map<string, double> mSymbols;
-	unordered_map<string, Entity*> mDirectives;
-	regex *mCommentPattern = nullptr;
-	regex *mSymbolSetPattern = nullptr;
-	regex *mDirectivePattern = nullptr, *mDirectiveSetPattern = nullptr, *mDirectiveCallPattern = nullptr, *mDirectiveIncludePattern = nullptr;
+	bool mOptimize = true;
+	bool mMemoize = true;
+	ASTValueStack mStack;
+	// intermediate values of every program being executed, innermost last
+	vector<double> mOperands;
+	// the program of the line being resolved
+	ASTProgram mProgram;
+	ASTOptimizer mOptimizer;
+	ASTCompiler mCompiler;
+	shared_ptr<ASTLibrary> mLibrary;
+	// assigned here, over the globals of the library; indexed by interned name
+	vector<ASTSymbol> mSymbols;
+	// indexed by interned name
+	vector<ASTMemoSlot> mMemos;
+	size_t mMemosUsed = 0;
+	unsigned mJitThreshold = 0;
+	// indexed by interned name
+	vector<ASTJitSlot> mJits;
+	ASTIncludeCache mIncludes;
+	ASTTracer mTracer;
+	unique_ptr<ASTProfiler> mProfiler;
+
+	// The evaluator, once with tracing and once without; the public methods
+	// of the same names pick one by whether tracing or profiling is on.
+	bool IsTracing();
+	template<typename Trace> void Execute(const ASTProgram &p);
+	template<typename Trace> void CallDirective(unsigned id, bool negative, bool ignore_error, ASTCallSite *site);
+	template<typename Trace> double GetSymbol(unsigned id, bool negative, bool ignore_error);
+	template<typename Trace> void SetSymbol(unsigned id, double v);
+	template<typename Trace> double PopFromStack();
+	template<typename Trace> void PushToStack(double v);
+	// after a Reserve, or a check that the stack is not empty
+	template<typename Trace> double PopFromStackUnchecked();
+	template<typename Trace> void PushToStackUnchecked(double v);
+
+	void CallBuiltin(ASTCallSite::BuiltinType builtin);
+	unsigned GetDirectiveVersion(unsigned id);
+	void ResolveCallSite(ASTCallSite &site, unsigned id);
+	void CheckPurity(ASTDirective *d);
+	ASTMemo& GetMemo(unsigned id);
+	bool RunCompiled(unsigned id, const ASTDirective *d);
+	shared_ptr<ASTInclude> LoadInclude(const string &path, const ASTIncludeKey &key);
 };
@@ -0,0 +1,393 @@
+#include "jit.hpp"
+
+#include "names.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define AST_X86_64_JIT
+#endif
+
+using namespace std;
+
+ASTJitCode::ASTJitCode(void *code, size_t mapped, size_t length, unsigned pops, size_t symbols) :
+	mCode(code), mMapped(mapped), mLength(length), mFunction((Function)code), mPops(pops), mSymbols(symbols) {
+}
+
+unsigned ASTJitCode::GetPops() const {
+	return mPops;
+}
+
+size_t ASTJitCode::GetSymbolsLength() const {
+	return mSymbols;
+}
+
+size_t ASTJitCode::GetLength() const {
+	return mLength;
+}
+
+ASTJitCode::~ASTJitCode() {
+#ifdef AST_X86_64_JIT
+	munmap(mCode, mMapped);
+#endif
+}
+
+bool ASTJit::IsSupported() {
+#ifdef AST_X86_64_JIT
+	// SSE2 is part of x86-64 itself
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef AST_X86_64_JIT
+
+// -- MARK: Encoding
+
+// Writes the few x86-64 instructions the compiler needs. Every memory
+// operand is a base register with a 32-bit displacement.
+class ASTJitEmitter {
+public:
+	typedef enum {
+		RAX = 0,
+		RSP = 4,
+		RBX = 3,
+		RBP = 5,
+		R13 = 13,
+	} Register;
+
+	vector<uint8_t> code;
+
+	void Byte(uint8_t b) {
+		code.push_back(b);
+	}
+
+	void Int32(int32_t v) {
+		for (int i = 0; i < 4; i++)
+			Byte((uint32_t)v >> (8 * i));
+	}
+
+	void Int64(uint64_t v) {
+		for (int i = 0; i < 8; i++)
+			Byte(v >> (8 * i));
+	}
+
+	// prefix 0F op, with xmm `reg` and xmm `rm`
+	void SSE(uint8_t prefix, uint8_t op, int reg, int rm) {
+		Byte(prefix);
+		Rex(false, reg, rm);
+		Byte(0x0F);
+		Byte(op);
+		Byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+	}
+
+	// prefix 0F op, with xmm `reg` and [base + disp]
+	void SSE(uint8_t prefix, uint8_t op, int reg, Register base, int32_t disp) {
+		Byte(prefix);
+		Rex(false, reg, base);
+		Byte(0x0F);
+		Byte(op);
+		Memory(reg, base, disp);
+	}
+
+	void Load(int xmm, Register base, int32_t disp) {
+		SSE(0xF2, 0x10, xmm, base, disp);
+	}
+
+	void Store(Register base, int32_t disp, int xmm) {
+		SSE(0xF2, 0x11, xmm, base, disp);
+	}
+
+	void Move(int to, int from) {
+		if (to != from)
+			SSE(0x66, 0x28, to, from);
+	}
+
+	void Literal(int xmm, double v) {
+		uint64_t bits;
+
+		memcpy(&bits, &v, sizeof(bits));
+		// mov rax, imm64; movq xmm, rax
+		Byte(0x48);
+		Byte(0xB8);
+		Int64(bits);
+		Byte(0x66);
+		Rex(true, xmm, RAX);
+		Byte(0x0F);
+		Byte(0x6E);
+		Byte(0xC0 | (xmm & 7) << 3);
+	}
+
+	// Flips the sign bit, as C++ negation does.
+	void Negate(int xmm) {
+		// movq rax, xmm; btc rax, 63; movq xmm, rax
+		Byte(0x66);
+		Rex(true, xmm, RAX);
+		Byte(0x0F);
+		Byte(0x7E);
+		Byte(0xC0 | (xmm & 7) << 3);
+		Byte(0x48);
+		Byte(0x0F);
+		Byte(0xBA);
+		Byte(0xF8);
+		Byte(63);
+		Byte(0x66);
+		Rex(true, xmm, RAX);
+		Byte(0x0F);
+		Byte(0x6E);
+		Byte(0xC0 | (xmm & 7) << 3);
+	}
+
+	// cmp byte [base + disp], 0; je, returning where the target goes
+	size_t JumpIfZero(Register base, int32_t disp) {
+		Byte(0x80);
+		Memory(7, base, disp);
+		Byte(0);
+		Byte(0x0F);
+		Byte(0x84);
+		Int32(0);
+		return code.size() - 4;
+	}
+
+	void Patch(size_t at, size_t target) {
+		int32_t rel = (int32_t)(target - (at + 4));
+		memcpy(&code[at], &rel, sizeof(rel));
+	}
+
+	// mov byte [base + disp], v
+	void SetByte(Register base, int32_t disp, uint8_t v) {
+		Byte(0xC6);
+		Memory(0, base, disp);
+		Byte(v);
+	}
+
+	void Call(const void *f) {
+		// mov rax, imm64; call rax
+		Byte(0x48);
+		Byte(0xB8);
+		Int64((uint64_t)(uintptr_t)f);
+		Byte(0xFF);
+		Byte(0xD0);
+	}
+
+	void Prologue(int32_t frame) {
+		// push rbx; push rbp; push r13
+		Byte(0x53);
+		Byte(0x55);
+		Byte(0x41);
+		Byte(0x55);
+		// sub rsp, frame
+		Byte(0x48);
+		Byte(0x81);
+		Byte(0xEC);
+		Int32(frame);
+		// mov rbx, rdi; mov rbp, rsi; mov r13, rdx
+		Byte(0x48);
+		Byte(0x89);
+		Byte(0xFB);
+		Byte(0x48);
+		Byte(0x89);
+		Byte(0xF5);
+		Byte(0x49);
+		Byte(0x89);
+		Byte(0xD5);
+	}
+
+	void Epilogue(int32_t frame, bool result) {
+		// mov eax, 1 or xor eax, eax
+		if (result) {
+			Byte(0xB8);
+			Int32(1);
+		} else {
+			Byte(0x31);
+			Byte(0xC0);
+		}
+		// add rsp, frame
+		Byte(0x48);
+		Byte(0x81);
+		Byte(0xC4);
+		Int32(frame);
+		// pop r13; pop rbp; pop rbx; ret
+		Byte(0x41);
+		Byte(0x5D);
+		Byte(0x5D);
+		Byte(0x5B);
+		Byte(0xC3);
+	}
+protected:
+	void Rex(bool w, int reg, int rm) {
+		uint8_t rex = 0x40 | w << 3 | (reg >> 3) << 2 | (rm >> 3);
+
+		if (rex != 0x40)
+			Byte(rex);
+	}
+
+	void Memory(int reg, Register base, int32_t disp) {
+		Byte(0x80 | (reg & 7) << 3 | (base & 7));
+		// rsp as a base only goes through a SIB byte
+		if ((base & 7) == RSP)
+			Byte(0x24);
+		Int32(disp);
+	}
+};
+
+// -- MARK: Compilation
+
+// The operand stack lives in xmm0 upwards; a call to libm clobbers every
+// one of them, so the values below its operands are spilled around it.
+static const size_t MAX_DEPTH = 14;
+static const size_t SPILLS = MAX_DEPTH - 2;
+
+unique_ptr<ASTJitCode> ASTJit::Compile(const ASTProgram &p) {
+	typedef double (*Libm)(double, double);
+	static const Libm libm_fmod = static_cast<Libm>(&fmod), libm_pow = static_cast<Libm>(&pow);
+	ASTJitEmitter out;
+	vector<size_t> bails;
+	unordered_set<unsigned> stored, checked;
+	size_t depth = 0, symbols = 0;
+	unsigned pops = 0;
+
+	if (!p.returns || p.code.empty() || p.code.back().op != ASTInstruction::RETURN_VALUE ||
+		p.depth > MAX_DEPTH || p.locals > 1024)
+		return nullptr;
+
+	// the spills and locals, keeping rsp 16-byte aligned for the calls
+	const int32_t frame = (int32_t)(((SPILLS + p.locals) * sizeof(double) + 15) & ~(size_t)15);
+
+	out.Prologue(frame);
+
+	// a symbol read before the program assigns it must be assigned already,
+	// checked before anything is written so a bail-out changes nothing
+	for (const ASTInstruction &i : p.code) {
+		if (i.op == ASTInstruction::STORE_SYMBOL) {
+			stored.insert(i.name);
+		} else if (i.op == ASTInstruction::LOAD_SYMBOL && i.name != ASTNameTable::STACK_TOP_NAME &&
+				   i.name != ASTNameTable::STACK_SIZE_NAME && !stored.count(i.name) && checked.insert(i.name).second) {
+			if (i.name >= (INT32_MAX - sizeof(ASTSymbol)) / sizeof(ASTSymbol))
+				return nullptr;
+			bails.push_back(out.JumpIfZero(ASTJitEmitter::RBP, i.name * sizeof(ASTSymbol) + offsetof(ASTSymbol, defined)));
+		}
+	}
+
+	for (const ASTInstruction &i : p.code)
+		if (i.op == ASTInstruction::LOAD_SYMBOL && i.name == ASTNameTable::STACK_TOP_NAME)
+			pops++;
+
+	unsigned popped = 0;
+
+	for (const ASTInstruction &i : p.code) {
+		switch (i.op) {
+		case ASTInstruction::PUSH_LITERAL:
+			out.Literal(depth++, i.value);
+			break;
+		case ASTInstruction::LOAD_SYMBOL:
+			if (i.name == ASTNameTable::STACK_SIZE_NAME)
+				return nullptr;
+
+			// the first `_` is the top of the stack, the last one of `args`
+			if (i.name == ASTNameTable::STACK_TOP_NAME) {
+				out.Load(depth, ASTJitEmitter::RBX, (pops - 1 - popped++) * sizeof(double));
+			} else {
+				if (i.name >= (INT32_MAX - sizeof(ASTSymbol)) / sizeof(ASTSymbol))
+					return nullptr;
+				out.Load(depth, ASTJitEmitter::RBP, i.name * sizeof(ASTSymbol) + offsetof(ASTSymbol, value));
+				if (i.name >= symbols)
+					symbols = i.name + 1;
+			}
+
+			if (i.negative)
+				out.Negate(depth);
+			depth++;
+			break;
+		case ASTInstruction::STORE_SYMBOL:
+			if (i.name == ASTNameTable::STACK_TOP_NAME || i.name == ASTNameTable::STACK_SIZE_NAME ||
+				i.name >= (INT32_MAX - sizeof(ASTSymbol)) / sizeof(ASTSymbol))
+				return nullptr;
+
+			out.Store(ASTJitEmitter::RBP, i.name * sizeof(ASTSymbol) + offsetof(ASTSymbol, value), depth - 1);
+			out.SetByte(ASTJitEmitter::RBP, i.name * sizeof(ASTSymbol) + offsetof(ASTSymbol, defined), 1);
+			if (i.name >= symbols)
+				symbols = i.name + 1;
+			break;
+		case ASTInstruction::ARITHMETIC_ADD:
+			out.SSE(0xF2, 0x58, depth - 2, depth - 1);
+			depth--;
+			break;
+		case ASTInstruction::ARITHMETIC_SUB:
+			out.SSE(0xF2, 0x5C, depth - 2, depth - 1);
+			depth--;
+			break;
+		case ASTInstruction::ARITHMETIC_MUL:
+			out.SSE(0xF2, 0x59, depth - 2, depth - 1);
+			depth--;
+			break;
+		case ASTInstruction::ARITHMETIC_DIV:
+			out.SSE(0xF2, 0x5E, depth - 2, depth - 1);
+			depth--;
+			break;
+		case ASTInstruction::ARITHMETIC_MOD:
+		case ASTInstruction::ARITHMETIC_POW:
+			for (size_t s = 0; s + 2 < depth; s++)
+				out.Store(ASTJitEmitter::RSP, s * sizeof(double), s);
+			// never a source once written, see the operands' registers
+			out.Move(0, depth - 2);
+			out.Move(1, depth - 1);
+			out.Call((const void*)(i.op == ASTInstruction::ARITHMETIC_MOD ? libm_fmod : libm_pow));
+			out.Move(depth - 2, 0);
+			for (size_t s = 0; s + 2 < depth; s++)
+				out.Load(s, ASTJitEmitter::RSP, s * sizeof(double));
+			depth--;
+			break;
+		case ASTInstruction::NEGATE:
+			out.Negate(depth - 1);
+			break;
+		case ASTInstruction::STORE_LOCAL:
+			out.Store(ASTJitEmitter::RSP, (SPILLS + i.name) * sizeof(double), depth - 1);
+			break;
+		case ASTInstruction::LOAD_LOCAL:
+			out.Load(depth++, ASTJitEmitter::RSP, (SPILLS + i.name) * sizeof(double));
+			break;
+		case ASTInstruction::RETURN_VALUE:
+			out.Store(ASTJitEmitter::R13, 0, --depth);
+			break;
+		default:
+			return nullptr;
+		}
+	}
+
+	out.Epilogue(frame, true);
+	for (size_t at : bails)
+		out.Patch(at, out.code.size());
+	out.Epilogue(frame, false);
+
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t mapped = (out.code.size() + page - 1) / page * page;
+	void *code = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (code == MAP_FAILED)
+		return nullptr;
+
+	// never writable and executable at once
+	memcpy(code, out.code.data(), out.code.size());
+	if (mprotect(code, mapped, PROT_READ | PROT_EXEC) != 0) {
+		munmap(code, mapped);
+		return nullptr;
+	}
+
+	return unique_ptr<ASTJitCode>(new ASTJitCode(code, mapped, out.code.size(), pops, symbols));
+}
+
+#else
+
+unique_ptr<ASTJitCode> ASTJit::Compile(const ASTProgram &p) {
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "compiler.hpp"
+#include "library.hpp"
+
+#include <cstddef>
+#include <memory>
+
+using namespace std;
+
+// A directive body as x86-64 machine code, in a mapping of its own that is
+// executable but no longer writable. It reads its arguments in place on the
+// interpreter stack and the symbols of an interpreter, and either runs to
+// the end or changes nothing at all.
+class ASTJitCode {
+public:
+	// `args` are the top GetPops() values of the interpreter stack and
+	// `symbols` has at least GetSymbolsLength() entries. False when a symbol
+	// it reads is not assigned in `symbols`; the VM runs the body then.
+	typedef bool (*Function)(const double *args, ASTSymbol *symbols, double *result);
+
+	// Takes over `mapped` bytes at `code`, from mmap.
+	ASTJitCode(void *code, size_t mapped, size_t length, unsigned pops, size_t symbols);
+
+	bool Run(const double *args, ASTSymbol *symbols, double &result) const {
+		return mFunction(args, symbols, &result);
+	}
+
+	unsigned GetPops() const;
+	size_t GetSymbolsLength() const;
+	// bytes of machine code
+	size_t GetLength() const;
+	~ASTJitCode();
+protected:
+	void *mCode;
+	size_t mMapped, mLength;
+	Function mFunction;
+	unsigned mPops;
+	size_t mSymbols;
+private:
+	ASTJitCode(const ASTJitCode&) = delete;
+	ASTJitCode& operator=(const ASTJitCode&) = delete;
+};
+
+// Compiles the arithmetic subset of an ASTProgram to SSE2: literals, loads
+// and assignments of plain symbols, `_` as an argument, the four operations,
+// negation and locals, with `%` and `^` calling fmod and pow as Apply does.
+// Values live in registers, so the operand stack may be 14 deep at most.
+class ASTJit {
+public:
+	// Whether this build and platform can run compiled code at all.
+	static bool IsSupported();
+	// nullptr when `p` does anything else: calls a directive, reads `__`,
+	// pushes through `_ =`, raises an error or leaves no value behind.
+	static unique_ptr<ASTJitCode> Compile(const ASTProgram &p);
+};
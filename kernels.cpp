@@ -0,0 +1,153 @@
+#include "kernels.hpp"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define AST_X86_KERNELS
+#endif
+
+using namespace std;
+
+// -- MARK: Scalar
+
+static void ScalarAdd(double *l, const double *r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		l[i] += r[i];
+}
+
+static void ScalarSub(double *l, const double *r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		l[i] -= r[i];
+}
+
+static void ScalarMul(double *l, const double *r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		l[i] *= r[i];
+}
+
+static void ScalarDiv(double *l, const double *r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		l[i] /= r[i];
+}
+
+// the batched path of every target: no vector libm gives glibc's bits
+static void BatchMod(double *l, const double *r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		l[i] = fmod(l[i], r[i]);
+}
+
+static void BatchPow(double *l, const double *r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		l[i] = pow(l[i], r[i]);
+}
+
+#ifdef AST_X86_KERNELS
+
+// -- MARK: SSE2
+
+#define AST_SSE2_KERNEL(name, intrinsic, op) \
+	__attribute__((target("sse2"))) \
+	static void name(double *l, const double *r, size_t n) { \
+		size_t i = 0; \
+		for (; i + 2 <= n; i += 2) \
+			_mm_storeu_pd(l + i, intrinsic(_mm_loadu_pd(l + i), _mm_loadu_pd(r + i))); \
+		for (; i < n; i++) \
+			l[i] = l[i] op r[i]; \
+	}
+
+AST_SSE2_KERNEL(SSE2Add, _mm_add_pd, +)
+AST_SSE2_KERNEL(SSE2Sub, _mm_sub_pd, -)
+AST_SSE2_KERNEL(SSE2Mul, _mm_mul_pd, *)
+AST_SSE2_KERNEL(SSE2Div, _mm_div_pd, /)
+
+// -- MARK: AVX2
+
+#define AST_AVX2_KERNEL(name, intrinsic, op) \
+	__attribute__((target("avx2"))) \
+	static void name(double *l, const double *r, size_t n) { \
+		size_t i = 0; \
+		for (; i + 8 <= n; i += 8) { \
+			_mm256_storeu_pd(l + i, intrinsic(_mm256_loadu_pd(l + i), _mm256_loadu_pd(r + i))); \
+			_mm256_storeu_pd(l + i + 4, intrinsic(_mm256_loadu_pd(l + i + 4), _mm256_loadu_pd(r + i + 4))); \
+		} \
+		for (; i < n; i++) \
+			l[i] = l[i] op r[i]; \
+	}
+
+AST_AVX2_KERNEL(AVX2Add, _mm256_add_pd, +)
+AST_AVX2_KERNEL(AVX2Sub, _mm256_sub_pd, -)
+AST_AVX2_KERNEL(AVX2Mul, _mm256_mul_pd, *)
+AST_AVX2_KERNEL(AVX2Div, _mm256_div_pd, /)
+
+#endif
+
+// -- MARK: Dispatch
+
+ASTKernels::Target ASTKernels::GetBestTarget() {
+	static const Target best = IsSupported(AVX2_TARGET) ? AVX2_TARGET :
+		IsSupported(SSE2_TARGET) ? SSE2_TARGET : SCALAR_TARGET;
+	return best;
+}
+
+bool ASTKernels::IsSupported(Target target) {
+	switch (target) {
+#ifdef AST_X86_KERNELS
+	case AVX2_TARGET:
+		return __builtin_cpu_supports("avx2");
+	case SSE2_TARGET:
+		return __builtin_cpu_supports("sse2");
+#endif
+	case SCALAR_TARGET:
+		return true;
+	default:
+		return false;
+	}
+}
+
+const char* ASTKernels::GetTargetString(Target target) {
+	switch (target) {
+	case AVX2_TARGET:
+		return "avx2";
+	case SSE2_TARGET:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
+
+ASTKernels::Binary ASTKernels::Get(ASTInstruction::OpCode op, Target target) {
+	static const Binary scalar[] = { ScalarAdd, ScalarSub, ScalarMul, ScalarDiv };
+#ifdef AST_X86_KERNELS
+	static const Binary sse2[] = { SSE2Add, SSE2Sub, SSE2Mul, SSE2Div };
+	static const Binary avx2[] = { AVX2Add, AVX2Sub, AVX2Mul, AVX2Div };
+#endif
+
+	if (op == ASTInstruction::ARITHMETIC_MOD)
+		return BatchMod;
+	else if (op == ASTInstruction::ARITHMETIC_POW)
+		return BatchPow;
+
+	const size_t i = op - ASTInstruction::ARITHMETIC_ADD;
+
+	switch (target) {
+#ifdef AST_X86_KERNELS
+	case AVX2_TARGET:
+		return avx2[i];
+	case SSE2_TARGET:
+		return sse2[i];
+#endif
+	default:
+		return scalar[i];
+	}
+}
+
+void ASTKernels::Negate(double *v, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		v[i] = -v[i];
+}
+
+void ASTKernels::Fill(double *v, double value, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		v[i] = value;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "compiler.hpp"
+
+#include <cstddef>
+
+using namespace std;
+
+// Arithmetic over whole columns, `l[i] = l[i] op r[i]`. Each instruction set
+// gives the same bits as ASTCompiler::Apply: add, sub, mul and div are
+// exactly rounded whatever the width, and pow and fmod always go through
+// libm one element at a time. The one exception is which NaN comes out of
+// two NaNs, as compilers swap the operands of commutative operations.
+class ASTKernels {
+public:
+	typedef enum {
+		SCALAR_TARGET,
+		SSE2_TARGET,
+		AVX2_TARGET,
+	} Target;
+
+	typedef void (*Binary)(double *l, const double *r, size_t n);
+
+	// The widest target this CPU runs, checked once.
+	static Target GetBestTarget();
+	static bool IsSupported(Target target);
+	static const char* GetTargetString(Target target);
+	// `op` is one of ARITHMETIC_*.
+	static Binary Get(ASTInstruction::OpCode op, Target target);
+	static void Negate(double *v, size_t n);
+	static void Fill(double *v, double value, size_t n);
+};
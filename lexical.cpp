@@ -1,386 +1,390 @@
 #include "lexical.hpp"
 
-ASTLex::ASTLex() {}
-
-Entity* ASTLex::GetEntityFrom(string code) {
-	Entity* VAL = nullptr;
-	if (OperandEntity::IsValid(code)) {
-		VAL = new OperandEntity(code);
-	} else if (LiteralEntity::IsValid(code)) {
-		VAL = new LiteralEntity(code);
-	} else {
+#include "names.hpp"
+
+// Names are interned straight from the line, without a copy of their own.
+static inline unsigned Intern(ASTTokenizer &tokens, const ASTToken &t) {
+	return ASTNameTable::Intern(tokens.GetData(t), t.length);
+}
+
+Entity* ASTLex::GetEntityFrom(ASTArena &arena, ASTTokenizer &tokens, const ASTToken &t, bool negative, ASTHashCons *cons) {
+	switch (t.type) {
+	case ASTToken::CONSTANT_TOKEN:
+		// "-inf" and "-nan" have always been read as (undefined) symbols
+		if (!negative)
+			return cons != nullptr ? cons->Literal(arena, tokens.GetText(t), t.number, negative) :
+				arena.New<LiteralEntity>(tokens.GetText(t), t.number, negative);
+		// fall through
+	case ASTToken::IDENTIFIER_TOKEN:
+		return cons != nullptr ? cons->Operand(arena, Intern(tokens, t), negative) :
+			arena.New<OperandEntity>(Intern(tokens, t), negative);
+	case ASTToken::NUMBER_TOKEN:
+		return cons != nullptr ? cons->Literal(arena, tokens.GetText(t), t.number, negative) :
+			arena.New<LiteralEntity>(tokens.GetText(t), t.number, negative);
+	default:
 		throw ASTSyntaxError("invalid syntax0");
 	}
-	return VAL;
 }
 
-Entity* ASTLex::Parse(string code, char separator) {
-	// We kind of skipped the tokenization part of the parser here, TODO
-	Entity* HEAD = nullptr;
-	CompoundEntity* TMP = new CompoundEntity(TieredEntity::OPERATOR_INVALID);
-
-	Entity *ENT = nullptr;
-
-	string tmp_str;
-
-	for (string::iterator it = code.begin(); it != code.end(); ++it) {
-		char c = *it;
-		CompoundEntity::OperatorType t;
-
-		if (c == separator) {
-			try {
-				string s(code.substr(++it - code.begin()));
-				Entity *n = Parse(s, separator);
-				if (ENT != nullptr) {
-					CLEANUP(TMP);
-					return new CompoundEntity(TieredEntity::DIRECTIVE_ARGS, ENT, n);
-				} if (!tmp_str.empty()) {
-					CLEANUP(TMP);
-					return new CompoundEntity(TieredEntity::DIRECTIVE_ARGS, Parse(tmp_str), n);
-				} else {
-					CLEANUP(TMP);
-					return n;
-				}
-				break;
-			} catch (const ASTException &ex) {
-				CLEANUP(HEAD);
-				CLEANUP(TMP);
-				CLEANUP(ENT);
-				throw ex;
-			}
-		} if (c == ' ' || c == '\t' || c == '\n') {
-			// ignore whitespace
-			continue;
-		} else if (c == ')') {
-			CLEANUP(HEAD);
-			CLEANUP(TMP);
-			CLEANUP(ENT);
-			throw ASTSyntaxError("invalid syntax1");
-		} else if (c == '(') {
-			if (ENT != nullptr) {
-				CLEANUP(HEAD);
-				CLEANUP(TMP);
-				CLEANUP(ENT);
-				throw ASTSyntaxError("invalid syntax(");
-			}
-
-			int level = 1;
-			size_t begin = ++it -  code.begin();
-			bool negative = false, caller = false;
-
-			// negative sign
-			if (!tmp_str.empty()) {
-				if (tmp_str[0] == '-') {
-					negative = true;
-					caller = !((tmp_str = tmp_str.substr(1)).empty());
-				} else caller = true;
-			}
+// -- MARK: Parser
+
+// One level of nesting: the whole line, a parenthesis group or a call's
+// argument list. Operands and operators live on shared stacks above the
+// frame's bases, so parsing never recurses and deep input only grows vectors.
+struct ASTParseFrame {
+	typedef enum {
+		LINE_FRAME,
+		PARENTHESIS_FRAME,
+		FUNCTION_FRAME,
+	} FrameType;
+
+	FrameType type;
+	const ASTToken *name;
+	bool negative;
+	size_t operands, operators, segments, arguments;
+};
+
+// Scratch stacks of the parser, kept by ASTLex so their capacity is reused
+// from one line to the next.
+struct ASTParseState {
+	ASTArena *arena = nullptr;
+	// set when parsing into a DAG
+	ASTHashCons *cons = nullptr;
+	vector<ASTParseFrame> frames;
+	vector<Entity*> operands;
+	vector<TieredEntity::OperatorType> operators;
+	// expressions left of a separator, waiting for their right side
+	vector<Entity*> segments;
+	// finished arguments of the open calls
+	vector<Entity*> arguments;
+	bool expect_operand = true;
+	bool negative = false;
+
+	void Clear(ASTArena &a, ASTHashCons *c) {
+		arena = &a;
+		cons = c;
+		frames.clear();
+		operands.clear();
+		operators.clear();
+		segments.clear();
+		arguments.clear();
+		expect_operand = true;
+		negative = false;
+	}
 
-			for (;it != code.end(); ++it) {
-				c = *it;
+	void Reduce() {
+		TieredEntity::OperatorType op = operators.back();
+		Entity *r = operands.back();
+		operands.pop_back();
+		Entity *l = operands.back();
 
-				if (c == '(')
-					level++;
-				else if (c == ')')
-					level--;
+		operators.pop_back();
+		operands.back() = NewCompound(op, l, r);
+	}
 
-				//cout << "level " << level << ": " << c << endl;
+	Entity* NewCompound(TieredEntity::OperatorType op, Entity *l, Entity *r) {
+		if (cons != nullptr)
+			return cons->Compound(*arena, op, l, r);
+		return arena->New<CompoundEntity>(op, l, r);
+	}
 
-				if (level == 0) {
-					//cout << "BREAK" << endl;
-					break;
-				}
- 			}
+	void PushOperator(TieredEntity::OperatorType op) {
+		const size_t base = frames.back().operators;
+		const int p = TieredEntity::PRECEDENCE(op);
+		const bool left = TieredEntity::ASSOCIATIVE(op) == TieredEntity::ASSOC_LEFT;
+
+		// lower precedence values bind tighter
+		while (operators.size() > base) {
+			const int q = TieredEntity::PRECEDENCE(operators.back());
+			if (q < p || (left && q == p))
+				Reduce();
+			else
+				break;
+		}
 
- 			//cout << "break" << endl;
+		operators.push_back(op);
+	}
 
-			if (level != 0 || ENT != nullptr) {
-				CLEANUP(HEAD);
-				CLEANUP(TMP);
-				CLEANUP(ENT);
-				throw ASTSyntaxError("invalid syntax3");
-			} else {
-				string sc(code.substr(begin, it - code.begin() - begin));
-				//cout << "sc " << sc << endl;
-
-				try {
-					if (caller) {
-						Entity *arg;
-						bool parenthesis = false;
-						FunctionEntity *cl = new FunctionEntity(tmp_str);
-						cl->SetNegative(negative);
-						ENT = cl;
-
-						level = 0;
-
-						string tchild;
-						for (string::iterator st=sc.begin(); st != sc.end(); ++st) {
-							char c = *st;
-							if (c == '(') {
-								parenthesis = true;
-								level++;
-							} else if (c == ')') {
-								parenthesis = false;
-								level--;
-							}
-
-							if (level == 0 && !parenthesis && c == ';') {
-								//cout << "tchild0[" << level << "] " << tchild << endl;
-								arg = Parse(tchild);
-								cl->AddArgument(arg);
-								tchild.clear();
-								//cout << "tchild CLEARED" << endl;
-							} else tchild += c;
-						}
-
-						//cout << "tchild1[" << level << "] " << tchild << endl;
-
-						arg = Parse(tchild);
-						cl->AddArgument(arg);
-						tchild.clear();
-
-						/*
-						Entity *s = Parse(sc, ';');
-						ENT = s;
-
-						if (s == nullptr)
-							ENT = cl;
-						else
-							ENT = new CompoundEntity(TieredEntity::DIRECTIVE_CALL, s, cl);
-						*/
-					} else {
-						ENT = new ParenthesisEntity(Parse(sc), negative);
-					}
-				} catch (ASTException *ex) {
-					//cout << "INNER ERROR" << endl;
-					CLEANUP(HEAD);
-					CLEANUP(TMP);
-					CLEANUP(ENT);
-
-					throw ex;
-				}
-			}
+	// Closes the expression after the last separator of the current frame.
+	Entity* FinishSegment() {
+		const ASTParseFrame &f = frames.back();
 
-			tmp_str.clear();
-		} else if ((t = TieredEntity::OPERATOR(c)) != TieredEntity::OPERATOR_INVALID) {
-			auto OP = TMP->GetOperator();
-			if (t == TieredEntity::ARITHMETIC_SUB && tmp_str.empty() && ENT == nullptr) {
-				// negative sign for literal
-				tmp_str += c;
-				continue;
+		if (expect_operand) {
+			if (operands.size() == f.operands && operators.size() == f.operators) {
+				if (negative)
+					throw ASTSyntaxError("invalid syntax4: -");
+				return nullptr;
 			}
+			throw ASTSyntaxError("invalid syntax0");
+		}
 
-			try {
-				if (ENT == nullptr)
-					ENT = GetEntityFrom(tmp_str);
-			} catch (ASTException *ex) {
-				//cout << "HELP!" << endl;
-				CLEANUP(HEAD);
-				CLEANUP(TMP);
-				CLEANUP(ENT);
-				throw ex;
-			}
+		while (operators.size() > f.operators)
+			Reduce();
 
-			if (OP == TieredEntity::OPERATOR_INVALID) {
-				// set left and operator
-				TMP->SetOperator(t);
-				//cout << "OPERATOR: " << TMP->GetOperatorString() << endl;
-				TMP->Set(CompoundEntity::LEFT_ENTITY, ENT);
-				tmp_str.clear();
-			} else {
-				// set right
-				TMP->Set(CompoundEntity::RIGHT_ENTITY, ENT);
-
-				if (HEAD == nullptr) {
-					HEAD = TMP;
-				} else {
-					switch(TMP->GetOperatorAssociativity()) {
-					case TieredEntity::ASSOC_LEFT:
-						LeftAssociate(&HEAD, TMP);
-						break;
-					case TieredEntity::ASSOC_RIGHT:
-						RightAssociate(&HEAD, TMP);
-						break;
-					default:
-						// should not go here
-						break;
-					}
-				}
-
-				// then store operator back
-				TMP = new CompoundEntity(t, nullptr, nullptr);
-				tmp_str.clear();
-			}
+		Entity *e = operands.back();
+		operands.pop_back();
+		return e;
+	}
 
-			ENT = nullptr;
-		} else {
-			tmp_str += c;
+	// Closes the current frame's expression, folding `a \n b \n c` into
+	// DIRECTIVE_ARGS(a, DIRECTIVE_ARGS(b, c)).
+	Entity* Finish() {
+		Entity *e = FinishSegment();
+		const size_t base = frames.back().segments;
+
+		while (segments.size() > base) {
+			Entity *l = segments.back();
+			segments.pop_back();
+			if (l != nullptr)
+				e = NewCompound(TieredEntity::DIRECTIVE_ARGS, l, e);
 		}
+
+		expect_operand = true;
+		negative = false;
+		return e;
 	}
 
-	if (HEAD == nullptr) {
-		if (TMP->GetOperator() == CompoundEntity::OPERATOR_INVALID) {
-			// single value
-			CLEANUP(TMP); // we don't need this anymore.
-
-			if (ENT != nullptr)
-				HEAD = ENT;
-			else if (OperandEntity::IsValid(tmp_str))
-				HEAD = new OperandEntity(tmp_str);
-			else if (LiteralEntity::IsValid(tmp_str))
-				HEAD = new LiteralEntity(tmp_str);
-			else if (!tmp_str.empty())
-				throw ASTSyntaxError("invalid syntax4: " + tmp_str);
-		} else {
-			try {
-				if (ENT == nullptr)
-					ENT = GetEntityFrom(tmp_str);
-			} catch (ASTException *ex) {
-				//cout << "HELP" << endl;
-				CLEANUP(HEAD);
-				CLEANUP(TMP);
-				CLEANUP(ENT);
-				throw ex;
-			}
+	// A value runs up to the next operator, parenthesis or separator, like
+	// it always has, so `1;2` outside a call is one value and not three.
+	size_t ValueEnd(ASTTokenizer &tokens, size_t i) {
+		const bool call = frames.back().type == ASTParseFrame::FUNCTION_FRAME;
+		const size_t n = tokens.GetLength();
 
-			TMP->Set(CompoundEntity::RIGHT_ENTITY, ENT);
-			HEAD = TMP;
-		}
-	} else {
-		try {
-			if (ENT == nullptr)
-				ENT = GetEntityFrom(tmp_str);
-		} catch (ASTException *ex) {
-			//cout << "HELP" << endl;
-			CLEANUP(HEAD);
-			CLEANUP(TMP);
-			CLEANUP(ENT);
-			throw ex;
+		for (; i < n; i++) {
+			const ASTToken::TokenType type = tokens.Get(i).type;
+			if (type == ASTToken::ARGUMENT_TOKEN ? call : type > ASTToken::CONSTANT_TOKEN)
+				break;
 		}
 
-		// set right
-		TMP->Set(CompoundEntity::RIGHT_ENTITY, ENT);
+		return i;
+	}
 
-		if (HEAD == nullptr) {
-			HEAD = TMP;
-		} else {
-			switch(TMP->GetOperatorAssociativity()) {
-			case TieredEntity::ASSOC_LEFT:
-				LeftAssociate(&HEAD, TMP);
-				break;
-			case TieredEntity::ASSOC_RIGHT:
-				RightAssociate(&HEAD, TMP);
-				break;
-			default:
-				// should not go here
-				break;
-			}
+	// Throws for the invalid value in tokens [i, end), with the messages the
+	// character-by-character parser gave: the value's text when it is the
+	// whole expression, a bare "invalid syntax0" when it is an operand.
+	void InvalidValue(ASTTokenizer &tokens, size_t i, size_t end) {
+		const ASTParseFrame &f = frames.back();
+		const ASTToken::TokenType next = end < tokens.GetLength() ? tokens.Get(end).type : ASTToken::SEPARATOR_TOKEN;
+
+		if (next == ASTToken::CLOSE_TOKEN && f.type == ASTParseFrame::LINE_FRAME)
+			throw ASTSyntaxError("invalid syntax1");
+
+		if (operands.size() == f.operands && operators.size() == f.operators &&
+			(next == ASTToken::SEPARATOR_TOKEN || next == ASTToken::CLOSE_TOKEN)) {
+			string text(negative ? "-" : "");
+			for (; i < end; i++)
+				text += tokens.GetText(tokens.Get(i));
+			throw ASTSyntaxError("invalid syntax4: " + text);
 		}
+
+		throw ASTSyntaxError("invalid syntax0");
+	}
+
+	void PushFrame(ASTParseFrame::FrameType type, const ASTToken *name) {
+		ASTParseFrame f;
+		f.type = type;
+		f.name = name;
+		f.negative = negative;
+		f.operands = operands.size();
+		f.operators = operators.size();
+		f.segments = segments.size();
+		f.arguments = arguments.size();
+		frames.push_back(f);
+
+		expect_operand = true;
+		negative = false;
 	}
+};
 
-	return HEAD;
+ASTLex::ASTLex() : mParseState(new ASTParseState()) {}
+
+Entity* ASTLex::Parse(const string &code, char separator) {
+	return Parse(code.data(), code.length(), mArena, separator);
 }
 
-void ASTLex::LeftAssociate(Entity **HEAD, CompoundEntity *TMP) {
-	// process
-	CompoundEntity *CUR = (CompoundEntity*) *HEAD;
-
-	if (CUR->GetOperatorPrecedence() <= TMP->GetOperatorPrecedence()) {
-		TMP->Set(CompoundEntity::LEFT_ENTITY, CUR);
-		*HEAD = TMP;
-	} else {
-		for(;;) {
-			Entity *n = CUR->Get(CompoundEntity::RIGHT_ENTITY);
-			if (n == nullptr) {
-				break;
-			} else if (n->GetType() == Entity::COMPOUND_ENTITY) {
-				if (((CompoundEntity*)n)->GetOperatorPrecedence() > TMP->GetOperatorPrecedence())
-					CUR = (CompoundEntity*) n;
-				else
-					break;
+Entity* ASTLex::Parse(const string &code, ASTArena &arena, char separator) {
+	return Parse(code.data(), code.length(), arena, separator);
+}
+
+Entity* ASTLex::Parse(const char *code, size_t length, ASTArena &arena, char separator) {
+	ASTTokenizer &tokens = mTokenizer;
+	ASTParseState &st = *mParseState;
+
+	tokens.Tokenize(code, length, separator);
+	if (mHashConsing)
+		mHashCons.Clear();
+	st.Clear(arena, mHashConsing ? &mHashCons : nullptr);
+	st.PushFrame(ASTParseFrame::LINE_FRAME, nullptr);
+
+	const size_t n = tokens.GetLength();
+
+	for (size_t i = 0; i < n; i++) {
+		const ASTToken &t = tokens.Get(i);
+
+		switch (t.type) {
+		case ASTToken::OPEN_TOKEN:
+			if (!st.expect_operand)
+				throw ASTSyntaxError("invalid syntax(");
+			st.PushFrame(ASTParseFrame::PARENTHESIS_FRAME, nullptr);
+			break;
+		case ASTToken::CLOSE_TOKEN: {
+			ASTParseFrame f = st.frames.back();
+			Entity *e;
+
+			if (f.type == ASTParseFrame::LINE_FRAME)
+				throw ASTSyntaxError("invalid syntax1");
+
+			e = st.Finish();
+			st.frames.pop_back();
+
+			if (f.type == ASTParseFrame::FUNCTION_FRAME && st.cons != nullptr) {
+				st.arguments.push_back(e);
+				st.operands.push_back(st.cons->Function(arena, Intern(tokens, *f.name), f.negative,
+					&st.arguments[f.arguments], st.arguments.size() - f.arguments));
+				st.arguments.resize(f.arguments);
+			} else if (f.type == ASTParseFrame::FUNCTION_FRAME) {
+				FunctionEntity *cl = arena.New<FunctionEntity>(Intern(tokens, *f.name), f.negative);
+
+				cl->ReserveArguments(st.arguments.size() - f.arguments + 1, arena);
+				for (size_t j = f.arguments; j < st.arguments.size(); j++)
+					cl->AddArgument(st.arguments[j]);
+				cl->AddArgument(e);
+
+				st.arguments.resize(f.arguments);
+				st.operands.push_back(cl);
+			} else if (st.cons != nullptr) {
+				st.operands.push_back(st.cons->Parenthesis(arena, e, f.negative));
 			} else {
-				break;
+				st.operands.push_back(arena.New<ParenthesisEntity>(e, f.negative));
 			}
+
+			st.expect_operand = false;
+			break;
 		}
-		TMP->Set(CompoundEntity::LEFT_ENTITY, CUR->Get(CompoundEntity::RIGHT_ENTITY));
-		CUR->Set(CompoundEntity::RIGHT_ENTITY, TMP);
-	}
-}
+		case ASTToken::SEPARATOR_TOKEN:
+			st.segments.push_back(st.FinishSegment());
+			st.expect_operand = true;
+			st.negative = false;
+			break;
+		case ASTToken::OPERATOR_TOKEN:
+			if (st.expect_operand) {
+				if (t.op != TieredEntity::ARITHMETIC_SUB || st.negative)
+					throw ASTSyntaxError("invalid syntax0");
+				// negative sign for the next value
+				st.negative = true;
+				break;
+			}
 
-void ASTLex::RightAssociate(Entity **HEAD, CompoundEntity *TMP) {
-	// process
-	CompoundEntity *CUR = (CompoundEntity*) *HEAD;
-
-	if (CUR->GetOperatorPrecedence() < TMP->GetOperatorPrecedence()) {
-		TMP->Set(CompoundEntity::LEFT_ENTITY, CUR);
-		*HEAD = TMP;
-	} else {
-		for(;;) {
-			Entity *n = CUR->Get(CompoundEntity::RIGHT_ENTITY);
-			if (n == nullptr) {
+			st.PushOperator(t.op);
+			st.expect_operand = true;
+			break;
+		case ASTToken::ARGUMENT_TOKEN:
+			if (st.frames.back().type == ASTParseFrame::FUNCTION_FRAME) {
+				st.arguments.push_back(st.Finish());
 				break;
-			} else if (n->GetType() == Entity::COMPOUND_ENTITY) {
-				if (((CompoundEntity*)n)->GetOperatorPrecedence() >= TMP->GetOperatorPrecedence())
-					CUR = (CompoundEntity*) n;
-				else
-					break;
+			}
+			// outside a call it is part of a value
+			// fall through
+		default: {
+			if (!st.expect_operand)
+				throw ASTSyntaxError("invalid syntax2: " + tokens.GetText(t));
+
+			const size_t end = st.ValueEnd(tokens, i);
+			const bool call = end < n && tokens.Get(end).type == ASTToken::OPEN_TOKEN;
+
+			if (!call && (end != i + 1 || t.type == ASTToken::INVALID_TOKEN || t.type == ASTToken::ARGUMENT_TOKEN))
+				st.InvalidValue(tokens, i, end);
+
+			if (call) {
+				if (end != i + 1 || t.type != ASTToken::IDENTIFIER_TOKEN)
+					throw ASTValueError("invalid value for operand");
+
+				st.PushFrame(ASTParseFrame::FUNCTION_FRAME, &t);
+				i++;
 			} else {
-				break;
+				st.operands.push_back(GetEntityFrom(arena, tokens, t, st.negative, st.cons));
+				st.negative = false;
+				st.expect_operand = false;
 			}
+			break;
+		}
 		}
-		TMP->Set(CompoundEntity::LEFT_ENTITY, CUR->Get(CompoundEntity::RIGHT_ENTITY));
-		CUR->Set(CompoundEntity::RIGHT_ENTITY, TMP);
 	}
+
+	if (st.frames.size() != 1)
+		throw ASTSyntaxError("invalid syntax3");
+
+	return st.Finish();
 }
 
 // -- MARK: Get postfix representation
 
-string ASTLex::GetPostfix(Entity *e) {
-	if (e == nullptr) {
-		return "[NULL]";
-	} else {
-		Entity::EntityType type = e->GetType();
-		if (type == Entity::FUNCTION_ENTITY) {
-			FunctionEntity *f = (FunctionEntity*) e;
-			string r("(func:" + e->GetString());
-
-			if (f->HasArguments()) {
-				vector<Entity*> args = f->GetArguments();
+// Either a node still to be written or a piece of text to append.
+struct ASTPostfixStep {
+	Entity *e;
+	const char *text;
+	// the operator of compound `e`
+	bool op;
+};
+
+// Without recursion, like the parser, so any tree it builds can be printed.
+string ASTLex::GetPostfix(Entity *root) {
+	vector<ASTPostfixStep> steps;
+	string r;
+
+	steps.push_back({root, nullptr, false});
+
+	while (!steps.empty()) {
+		ASTPostfixStep s = steps.back();
+		steps.pop_back();
+
+		if (s.text != nullptr) {
+			r += s.text;
+		} else if (s.op) {
+			r += ((CompoundEntity*)s.e)->GetOperatorString();
+		} else if (s.e == nullptr) {
+			r += "[NULL]";
+		} else if (s.e->GetType() == Entity::FUNCTION_ENTITY) {
+			FunctionEntity *f = (FunctionEntity*)s.e;
+			const size_t n = f->GetArgumentsLength();
+
+			r += "(func:" + f->GetString();
+			if (n > 0)
 				r += ":";
-				for (vector<Entity*>::iterator it = args.begin(); it != args.end(); ++it) {
-					r += GetPostfix(*it);
-					if (it != args.end() - 1) {
-						r += ";";
-					}
-				}
-			}
 
-			r += ")";
+			steps.push_back({nullptr, ")", false});
+			for (size_t i = n; i > 0; i--) {
+				steps.push_back({f->GetArgument(i - 1), nullptr, false});
+				if (i > 1)
+					steps.push_back({nullptr, ";", false});
+			}
+		} else if (s.e->GetType() == Entity::COMPOUND_ENTITY) {
+			CompoundEntity *c = (CompoundEntity*)s.e;
 
-			return r;
-		} else if (type != Entity::COMPOUND_ENTITY) {
-			return e->GetString();
+			// operands first, then the operator
+			steps.push_back({c, nullptr, true});
+			steps.push_back({c->Get(CompoundEntity::RIGHT_ENTITY), nullptr, false});
+			steps.push_back({c->Get(CompoundEntity::LEFT_ENTITY), nullptr, false});
 		} else {
-			string ls, rs;
-			CompoundEntity *c = (CompoundEntity*) e;
-			Entity *le = c->Get(CompoundEntity::LEFT_ENTITY), *re = c->Get(CompoundEntity::RIGHT_ENTITY);
+			Entity::WriteString(s.e, r);
+		}
+	}
 
-			if (le == nullptr)
-				ls = "[NULL]";
-			else ls = GetPostfix(le);
+	return r;
+}
 
-			if (re == nullptr)
-				rs = "[NULL]";
-			else rs = GetPostfix(re);
+ASTArena& ASTLex::GetArena() {
+	return mArena;
+}
 
-			return ls + rs + c->GetOperatorString();
-		}
-	}
+void ASTLex::SetHashConsing(bool hash_consing) {
+	mHashConsing = hash_consing;
 }
 
-ASTLex::~ASTLex() {}
+bool ASTLex::GetHashConsing() {
+	return mHashConsing;
+}
 
-void ASTLex::CLEANUP(Entity *e) {
-	if (e != nullptr)
-		delete e;
+ASTLex::~ASTLex() {
+	delete mParseState;
 }
@@ -1,16 +1,34 @@
 #pragma once
 
+#include "arena.hpp"
 #include "entities/entities.hpp"
+#include "hashcons.hpp"
+#include "tokenizer.hpp"
+
+struct ASTParseState;
 
 class ASTLex {
 public:
 	ASTLex();
-	Entity* GetEntityFrom(string code);
-	Entity* Parse(string code, char separator='\n');
-	void LeftAssociate(Entity **HEAD, CompoundEntity *TMP);
-	void RightAssociate(Entity **HEAD, CompoundEntity *TMP);
+	Entity* GetEntityFrom(ASTArena &arena, ASTTokenizer &tokens, const ASTToken &t, bool negative=false, ASTHashCons *cons=nullptr);
+	// Parses into the lexer's own arena, which the caller resets.
+	Entity* Parse(const string &code, char separator='\n');
+	Entity* Parse(const string &code, ASTArena &arena, char separator='\n');
+	Entity* Parse(const char *code, size_t length, ASTArena &arena, char separator='\n');
 	string GetPostfix(Entity *e);
+	ASTArena& GetArena();
+	// Parses into DAGs from now on, see ASTHashCons.
+	void SetHashConsing(bool hash_consing);
+	bool GetHashConsing();
 	~ASTLex();
 protected:
-	void CLEANUP(Entity *e);
-};
\ No newline at end of file
+	ASTArena mArena;
+	bool mHashConsing = false;
+	// the nodes of the last parse, when hash consing
+	ASTHashCons mHashCons;
+	ASTTokenizer mTokenizer;
+	ASTParseState *mParseState;
+private:
+	ASTLex(const ASTLex&) = delete;
+	ASTLex& operator=(const ASTLex&) = delete;
+};
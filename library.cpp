@@ -0,0 +1,64 @@
+#include "library.hpp"
+
+#include "names.hpp"
+
+using namespace std;
+
+ASTLibrary::ASTLibrary() {}
+
+bool ASTLibrary::IsFrozen() const {
+	return mFrozen;
+}
+
+void ASTLibrary::Freeze() {
+	mFrozen = true;
+}
+
+ASTDirective* ASTLibrary::GetDirective(unsigned id) const {
+	return id < mDirectives.size() ? mDirectives[id].directive : nullptr;
+}
+
+unsigned ASTLibrary::GetVersion(unsigned id) const {
+	return id < mDirectives.size() ? mDirectives[id].version : 0;
+}
+
+unsigned ASTLibrary::GetEpoch() const {
+	return mEpoch;
+}
+
+size_t ASTLibrary::GetLength() const {
+	return mDirectives.size();
+}
+
+const ASTSymbol* ASTLibrary::GetSymbol(unsigned id) const {
+	return id < mSymbols.size() && mSymbols[id].defined ? &mSymbols[id] : nullptr;
+}
+
+void ASTLibrary::SetDirective(unsigned id, ASTDirective *d) {
+	if (mFrozen) {
+		delete d;
+		throw ASTInvalidOperation("assignment to a directive of a shared library");
+	}
+
+	if (id >= mDirectives.size())
+		mDirectives.resize(ASTNameTable::GetLength());
+
+	// every call site still pointing at the old body re-resolves
+	ASTDirectiveSlot &slot = mDirectives[id];
+	delete slot.directive;
+	slot.directive = d;
+	slot.version++;
+	mEpoch++;
+}
+
+void ASTLibrary::SetSymbols(const vector<ASTSymbol> &symbols) {
+	if (mFrozen)
+		throw ASTInvalidOperation("assignment to a symbol of a shared library");
+
+	mSymbols = symbols;
+}
+
+ASTLibrary::~ASTLibrary() {
+	for (vector<ASTDirectiveSlot>::iterator it = mDirectives.begin(); it != mDirectives.end(); ++it)
+		delete it->directive;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "arena.hpp"
+#include "compiler.hpp"
+#include "entities/entities.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// A directive body owns its own arena, released when the name is redefined.
+// The body is compiled once, when the directive is set.
+struct ASTDirective {
+	Entity *body = nullptr;
+	ASTArena arena;
+	ASTProgram program;
+	// whether calling it changes nothing, and whether it also reads nothing
+	// but its arguments; valid while `epoch` is the library's epoch
+	bool pure = false, closed = false;
+	unsigned epoch = -1;
+};
+
+// The directive defined under one interned name. The version changes on
+// every redefinition, which invalidates call sites resolved to the old one.
+struct ASTDirectiveSlot {
+	ASTDirective *directive = nullptr;
+	unsigned version = 0;
+};
+
+// The value of one interned name, see ASTNameTable.
+struct ASTSymbol {
+	double value = 0;
+	bool defined = false;
+};
+
+// The directives and global symbols of a loaded script, apart from any
+// evaluation state. An interpreter fills its own library as it runs; once
+// frozen (see ASTInterpreter::Share) nothing in it changes anymore, so any
+// number of interpreters may evaluate against it from any thread.
+class ASTLibrary {
+public:
+	ASTLibrary();
+	bool IsFrozen() const;
+	void Freeze();
+	// nullptr when nothing is defined under `id`
+	ASTDirective* GetDirective(unsigned id) const;
+	unsigned GetVersion(unsigned id) const;
+	// changes with every directive set, as it may change what others call
+	unsigned GetEpoch() const;
+	size_t GetLength() const;
+	// nullptr when `id` is not a global symbol
+	const ASTSymbol* GetSymbol(unsigned id) const;
+	// Takes ownership of `d`. Throws once frozen.
+	void SetDirective(unsigned id, ASTDirective *d);
+	void SetSymbols(const vector<ASTSymbol> &symbols);
+	~ASTLibrary();
+protected:
+	// indexed by interned name
+	vector<ASTDirectiveSlot> mDirectives;
+	vector<ASTSymbol> mSymbols;
+	unsigned mEpoch = 0;
+	bool mFrozen = false;
+private:
+	ASTLibrary(const ASTLibrary&) = delete;
+	ASTLibrary& operator=(const ASTLibrary&) = delete;
+};
@@ -0,0 +1,101 @@
+#include "memo.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+void ASTMemo::Clear() {
+	mUsed.assign(mUsed.size(), false);
+	mLength = 0;
+}
+
+bool ASTMemo::Find(const double *args, unsigned argc, double &value) {
+	if (mLength > 0 && argc == mWidth) {
+		size_t i = Hash(args, argc) & (mUsed.size() - 1);
+
+		if (mUsed[i] && memcmp(mKeys.data() + i * argc, args, argc * sizeof(double)) == 0) {
+			value = mValues[i];
+			mHits++;
+			return true;
+		}
+	}
+
+	mMisses++;
+	return false;
+}
+
+void ASTMemo::Add(const double *args, unsigned argc, double value) {
+	if (mUsed.empty() || argc != mWidth) {
+		mWidth = argc;
+		mUsed.clear();
+		Resize(64);
+	}
+
+	size_t h = Hash(args, argc), i = h & (mUsed.size() - 1);
+
+	// rather than evict, grow once the table is half full
+	while (mUsed[i] && mLength * 2 >= mUsed.size() && mUsed.size() < CAPACITY) {
+		Resize(mUsed.size() * 2);
+		i = h & (mUsed.size() - 1);
+	}
+
+	if (!mUsed[i]) {
+		mUsed[i] = true;
+		mLength++;
+	}
+
+	memcpy(mKeys.data() + i * argc, args, argc * sizeof(double));
+	mValues[i] = value;
+}
+
+size_t ASTMemo::GetHits() {
+	return mHits;
+}
+
+size_t ASTMemo::GetMisses() {
+	return mMisses;
+}
+
+size_t ASTMemo::GetLength() {
+	return mLength;
+}
+
+// Rehashes into `size` entries, dropping whatever collides.
+void ASTMemo::Resize(size_t size) {
+	vector<double> keys(size * mWidth), values(size);
+	vector<bool> used(size, false);
+
+	mLength = 0;
+	for (size_t i = 0; i < mUsed.size(); i++) {
+		if (!mUsed[i])
+			continue;
+
+		const double *k = mKeys.data() + i * mWidth;
+		size_t j = Hash(k, mWidth) & (size - 1);
+
+		if (!used[j]) {
+			used[j] = true;
+			mLength++;
+		}
+		memcpy(keys.data() + j * mWidth, k, mWidth * sizeof(double));
+		values[j] = mValues[i];
+	}
+
+	mKeys.swap(keys);
+	mValues.swap(values);
+	mUsed.swap(used);
+}
+
+size_t ASTMemo::Hash(const double *args, unsigned argc) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (unsigned i = 0; i < argc; i++) {
+		uint64_t bits;
+		memcpy(&bits, &args[i], sizeof(bits));
+		h = (h ^ bits) * 0x100000001b3ULL;
+		h ^= h >> 32;
+	}
+
+	return (size_t)h;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Results of one pure directive keyed on its arguments. The table is
+// direct mapped and starts small, doubling on a collision once half full,
+// up to CAPACITY entries; otherwise a colliding result replaces the one it
+// lands on.
+// Arguments compare by bits, so -0 and +0 are different keys and a NaN
+// finds itself.
+class ASTMemo {
+public:
+	static const size_t CAPACITY = 4096;
+
+	// Forgets every result, the counters stay.
+	void Clear();
+	bool Find(const double *args, unsigned argc, double &value);
+	void Add(const double *args, unsigned argc, double value);
+	size_t GetHits();
+	size_t GetMisses();
+	size_t GetLength();
+protected:
+	// `mWidth` keys per entry, allocated on the first Add
+	vector<double> mKeys, mValues;
+	vector<bool> mUsed;
+	unsigned mWidth = 0;
+	size_t mLength = 0;
+	size_t mHits = 0, mMisses = 0;
+
+	void Resize(size_t size);
+	static size_t Hash(const double *args, unsigned argc);
+};
@@ -0,0 +1,174 @@
+#include "names.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// Names live in blocks that double in size and never move, so an id maps to
+// its string without a lock and GetName can hand out a reference.
+static const unsigned FIRST_BLOCK_BITS = 6;
+static const size_t MAX_BLOCKS = 26;
+
+static inline size_t GetBlock(size_t id, size_t &offset) {
+	const size_t n = id + ((size_t)1 << FIRST_BLOCK_BITS);
+	size_t block = 0;
+
+	while ((n >> (block + FIRST_BLOCK_BITS + 1)) != 0)
+		block++;
+
+	offset = n - ((size_t)1 << (block + FIRST_BLOCK_BITS));
+	return block;
+}
+
+static inline size_t Hash(const char *name, size_t length) {
+	// FNV-1a, names are short
+	size_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; i++)
+		h = (h ^ (unsigned char)name[i]) * 1099511628211ULL;
+	return h;
+}
+
+// Open addressing from the hash of a name to its id. A table is never
+// changed but to fill an empty slot; a full one is replaced by one twice its
+// size and kept, since readers may still be probing it.
+struct ASTNameSlots {
+	size_t mask;
+	atomic<unsigned> *ids;
+
+	ASTNameSlots(size_t size) : mask(size - 1), ids(new atomic<unsigned>[size]) {
+		for (size_t i = 0; i < size; i++)
+			ids[i].store(ASTNameTable::INVALID_NAME, memory_order_relaxed);
+	}
+
+	~ASTNameSlots() {
+		delete[] ids;
+	}
+};
+
+struct ASTNames {
+	atomic<string*> blocks[MAX_BLOCKS];
+	atomic<size_t> count;
+	atomic<ASTNameSlots*> slots;
+	vector<ASTNameSlots*> retired;
+	// only taken to add a name, lookups go without
+	mutex lock;
+
+	// in ReservedName order, so a builtin is known before any line names it
+	ASTNames() : count(0), slots(new ASTNameSlots((size_t)1 << FIRST_BLOCK_BITS)) {
+		for (size_t i = 0; i < MAX_BLOCKS; i++)
+			blocks[i].store(nullptr, memory_order_relaxed);
+
+		Add("_", 1);
+		Add("__", 2);
+		Add("__cmp_eq__", 10);
+		Add("__cmp_neq__", 11);
+		Add("__cmp_lt__", 10);
+		Add("__cmp_lte__", 11);
+		Add("__cmp_gt__", 10);
+		Add("__cmp_gte__", 11);
+	}
+
+	~ASTNames() {
+		for (size_t i = 0; i < MAX_BLOCKS; i++)
+			delete[] blocks[i].load(memory_order_relaxed);
+		for (ASTNameSlots *s : retired)
+			delete s;
+		delete slots.load(memory_order_relaxed);
+	}
+
+	const string& Get(unsigned id) {
+		size_t offset, block = GetBlock(id, offset);
+		return blocks[block].load(memory_order_acquire)[offset];
+	}
+
+	unsigned Find(const char *name, size_t length) {
+		ASTNameSlots *s = slots.load(memory_order_acquire);
+
+		for (size_t i = Hash(name, length) & s->mask;; i = (i + 1) & s->mask) {
+			unsigned id = s->ids[i].load(memory_order_acquire);
+			if (id == (unsigned)ASTNameTable::INVALID_NAME)
+				return id;
+
+			const string &k = Get(id);
+			if (k.length() == length && memcmp(k.data(), name, length) == 0)
+				return id;
+		}
+	}
+
+	static void Insert(ASTNameSlots *s, const string &name, unsigned id) {
+		size_t i = Hash(name.data(), name.length()) & s->mask;
+		while (s->ids[i].load(memory_order_relaxed) != (unsigned)ASTNameTable::INVALID_NAME)
+			i = (i + 1) & s->mask;
+		s->ids[i].store(id, memory_order_release);
+	}
+
+	// With `lock` held, or from the constructor.
+	unsigned Add(const char *name, size_t length) {
+		unsigned id = Find(name, length);
+		if (id != (unsigned)ASTNameTable::INVALID_NAME)
+			return id;
+
+		id = count.load(memory_order_relaxed);
+
+		size_t offset, block = GetBlock(id, offset);
+		string *b = blocks[block].load(memory_order_relaxed);
+		if (b == nullptr) {
+			b = new string[(size_t)1 << (block + FIRST_BLOCK_BITS)];
+			blocks[block].store(b, memory_order_release);
+		}
+		b[offset].assign(name, length);
+
+		// kept at most half full
+		ASTNameSlots *s = slots.load(memory_order_relaxed);
+		if ((id + 1) * 2 > s->mask + 1) {
+			ASTNameSlots *grown = new ASTNameSlots((s->mask + 1) * 2);
+			for (unsigned i = 0; i < id; i++)
+				Insert(grown, Get(i), i);
+
+			retired.push_back(s);
+			slots.store(s = grown, memory_order_release);
+		}
+
+		Insert(s, b[offset], id);
+		count.store(id + 1, memory_order_release);
+		return id;
+	}
+};
+
+static ASTNames& GetNames() {
+	static ASTNames names;
+	return names;
+}
+
+unsigned ASTNameTable::Intern(const string &name) {
+	return Intern(name.data(), name.length());
+}
+
+unsigned ASTNameTable::Intern(const char *name, size_t length) {
+	ASTNames &n = GetNames();
+	unsigned id = n.Find(name, length);
+	if (id != (unsigned)INVALID_NAME)
+		return id;
+
+	lock_guard<mutex> guard(n.lock);
+	return n.Add(name, length);
+}
+
+unsigned ASTNameTable::Find(const string &name) {
+	return Find(name.data(), name.length());
+}
+
+unsigned ASTNameTable::Find(const char *name, size_t length) {
+	return GetNames().Find(name, length);
+}
+
+const string& ASTNameTable::GetName(unsigned id) {
+	return GetNames().Get(id);
+}
+
+size_t ASTNameTable::GetLength() {
+	return GetNames().count.load(memory_order_acquire);
+}
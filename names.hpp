@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Process-wide table of symbol and directive names. A name is interned once,
+// at parse time, and from then on is known by its index, which interpreters
+// use directly as the slot of the symbol or directive. Safe to use from
+// any thread: lookups take no lock, only adding a new name does.
+class ASTNameTable {
+public:
+	typedef enum {
+		INVALID_NAME = -1,
+		// `_`, pops the stack
+		STACK_TOP_NAME,
+		// `__`, the stack size
+		STACK_SIZE_NAME,
+		// `__cmp_eq__` to `__cmp_gte__`, the comparison builtins, in
+		// ASTCallSite::BuiltinType order
+		CMP_EQ_NAME,
+		CMP_NEQ_NAME,
+		CMP_LT_NAME,
+		CMP_LTE_NAME,
+		CMP_GT_NAME,
+		CMP_GTE_NAME,
+	} ReservedName;
+
+	static unsigned Intern(const string &name);
+	static unsigned Intern(const char *name, size_t length);
+	// INVALID_NAME when the name was never interned
+	static unsigned Find(const string &name);
+	static unsigned Find(const char *name, size_t length);
+	static const string& GetName(unsigned id);
+	static size_t GetLength();
+};
@@ -0,0 +1,177 @@
+#include "number.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+// every power of ten up to 1e22 is exact in a double
+static const double sExactPowers[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static inline bool IsSpace(char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline char Lower(char c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static bool MatchesWord(const char *s, size_t n, const char *w) {
+	size_t len = strlen(w);
+
+	if (n < len)
+		return false;
+
+	for (size_t i = 0; i < len; i++)
+		if (Lower(s[i]) != w[i])
+			return false;
+
+	return true;
+}
+
+// -- MARK: Decoding
+
+size_t ASTNumber::Scan(const char *s, size_t n, double &r) {
+	size_t i = 0, count = 0, used;
+	bool negative = false, seen = false;
+	long exponent = 0;
+	// significant digits, without the point and leading zeros
+	char buffer[32];
+	string spill;
+
+	while (i < n && IsSpace(s[i]))
+		i++;
+
+	if (i < n && (s[i] == '+' || s[i] == '-'))
+		negative = s[i++] == '-';
+
+	if (i < n && !IsDigit(s[i]) && s[i] != '.') {
+		used = ScanConstant(s + i, n - i, r);
+		if (used == 0)
+			return 0;
+		if (negative)
+			r = -r;
+		return i + used;
+	}
+
+	for (bool fraction = false; i < n; i++) {
+		if (s[i] == '.' && !fraction) {
+			fraction = true;
+			continue;
+		} else if (!IsDigit(s[i])) {
+			break;
+		}
+
+		seen = true;
+		if (fraction)
+			exponent--;
+
+		if (count == 0 && s[i] == '0')
+			continue;
+
+		if (count < sizeof(buffer)) {
+			buffer[count] = s[i];
+		} else {
+			if (spill.empty())
+				spill.assign(buffer, count);
+			spill.push_back(s[i]);
+		}
+		count++;
+	}
+
+	// a lone "." is not a number
+	if (!seen)
+		return 0;
+
+	// the exponent only counts when digits follow it
+	if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+		size_t j = i + 1;
+		bool minus = false;
+		long e = 0;
+
+		if (j < n && (s[j] == '+' || s[j] == '-'))
+			minus = s[j++] == '-';
+
+		if (j < n && IsDigit(s[j])) {
+			for (; j < n && IsDigit(s[j]); j++)
+				if (e < 100000000)
+					e = e * 10 + (s[j] - '0');
+
+			exponent += minus ? -e : e;
+			i = j;
+		}
+	}
+
+	r = count == 0 ? 0 : Convert(spill.empty() ? buffer : spill.data(), count, exponent);
+	if (negative)
+		r = -r;
+
+	return i;
+}
+
+bool ASTNumber::Decode(const char *s, size_t n, double &r) {
+	return n > 0 && !IsSpace(s[0]) && Scan(s, n, r) == n;
+}
+
+bool ASTNumber::Decode(const string &s, double &r) {
+	return Decode(s.data(), s.length(), r);
+}
+
+size_t ASTNumber::ScanConstant(const char *s, size_t n, double &r) {
+	if (MatchesWord(s, n, "infinity")) {
+		r = INFINITY;
+		return 8;
+	} else if (MatchesWord(s, n, "inf")) {
+		r = INFINITY;
+		return 3;
+	} else if (MatchesWord(s, n, "nan")) {
+		r = NAN;
+		return 3;
+	}
+
+	return 0;
+}
+
+// Converts `digits` x 10^exponent. An integer below 2^53 scaled by an exact
+// power of ten needs a single rounding, so it is computed directly; anything
+// else goes to strtod in a form without a decimal point, which no locale
+// can change.
+double ASTNumber::Convert(const char *digits, size_t count, long exponent) {
+	if (count <= 19) {
+		uint64_t m = 0;
+
+		for (size_t i = 0; i < count; i++)
+			m = m * 10 + (digits[i] - '0');
+
+		if (m <= (uint64_t(1) << 53)) {
+			if (exponent >= 0 && exponent <= 22)
+				return (double)m * sExactPowers[exponent];
+			else if (exponent < 0 && exponent >= -22)
+				return (double)m / sExactPowers[-exponent];
+		}
+	}
+
+	char buffer[128];
+	string spill;
+	char *s = buffer;
+
+	if (count + 24 > sizeof(buffer)) {
+		spill.resize(count + 24);
+		s = &spill[0];
+	}
+
+	memcpy(s, digits, count);
+	snprintf(s + count, 24, "e%ld", exponent);
+
+	return strtod(s, nullptr);
+}
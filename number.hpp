@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Locale-independent decimal to double conversion, correctly rounded like
+// strtod in the "C" locale. Accepts an optional sign, digits with an
+// optional fraction and exponent, and inf, infinity or nan in any case.
+class ASTNumber {
+public:
+	// Reads the longest number at the start of `s` after any whitespace,
+	// like stod; returns the characters consumed, 0 when there is none.
+	static size_t Scan(const char *s, size_t n, double &r);
+	// The whole of `s` must be a number.
+	static bool Decode(const char *s, size_t n, double &r);
+	static bool Decode(const string &s, double &r);
+protected:
+	static size_t ScanConstant(const char *s, size_t n, double &r);
+	static double Convert(const char *digits, size_t count, long exponent);
+};
@@ -0,0 +1,193 @@
+#include "optimizer.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+Entity* ASTOptimizer::Optimize(Entity *root, ASTArena &arena, ASTHashCons *cons) {
+	vector<ASTOptimizeFrame> &frames = mFrames;
+	vector<ASTOptimizeResult> &results = mResults;
+
+	frames.clear();
+	results.clear();
+	frames.push_back({root, false});
+
+	while (!frames.empty()) {
+		ASTOptimizeFrame f = frames.back();
+		Entity *e = f.e;
+		frames.pop_back();
+
+		if (e == nullptr) {
+			results.push_back({nullptr, 0, false});
+			continue;
+		}
+
+		switch (e->GetType()) {
+		case Entity::PARENTHESIS_ENTITY: {
+			ParenthesisEntity *pe = (ParenthesisEntity*)e;
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				frames.push_back({pe->Get(), false});
+				break;
+			}
+
+			ASTOptimizeResult &inner = results.back();
+
+			if (inner.constant) {
+				if (pe->IsNegative()) {
+					inner.value = -inner.value;
+					inner.e = nullptr;
+				}
+			} else if (inner.e != pe->Get()) {
+				inner.e = cons != nullptr ? cons->Parenthesis(arena, inner.e, pe->IsNegative()) :
+					arena.New<ParenthesisEntity>(inner.e, pe->IsNegative());
+			} else {
+				inner.e = e;
+			}
+			break;
+		}
+		case Entity::COMPOUND_ENTITY: {
+			CompoundEntity *ce = (CompoundEntity*)e;
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				frames.push_back({ce->Get(CompoundEntity::RIGHT_ENTITY), false});
+				frames.push_back({ce->Get(CompoundEntity::LEFT_ENTITY), false});
+				break;
+			}
+
+			ASTOptimizeResult r = results.back();
+			results.pop_back();
+			ASTOptimizeResult &l = results.back();
+
+			l = Rewrite(ce, l, r, arena, cons);
+			break;
+		}
+		case Entity::FUNCTION_ENTITY: {
+			FunctionEntity *fe = (FunctionEntity*)e;
+			const size_t n = fe->GetArgumentsLength();
+
+			if (!f.done) {
+				frames.push_back({e, true});
+				for (size_t i = n; i > 0; i--)
+					frames.push_back({fe->GetArgument(i - 1), false});
+				break;
+			}
+
+			size_t first = results.size() - n;
+			bool changed = false;
+
+			for (size_t i = 0; i < n; i++)
+				if (Materialize(results[first + i], arena, cons) != fe->GetArgument(i))
+					changed = true;
+
+			if (changed && cons != nullptr) {
+				mArguments.clear();
+				for (size_t i = 0; i < n; i++)
+					mArguments.push_back(results[first + i].e);
+				e = cons->Function(arena, fe->GetName(), fe->IsNegative(), mArguments.data(), n);
+			} else if (changed) {
+				FunctionEntity *copy = arena.New<FunctionEntity>(fe->GetName(), fe->IsNegative());
+				copy->ReserveArguments(n, arena);
+				for (size_t i = 0; i < n; i++)
+					copy->AddArgument(results[first + i].e);
+				e = copy;
+			}
+
+			results.resize(first);
+			results.push_back({e, 0, false});
+			break;
+		}
+		case Entity::LITERAL_ENTITY:
+			results.push_back({e, ((LiteralEntity*)e)->GetNumber(), true});
+			break;
+		default:
+			results.push_back({e, 0, false});
+			break;
+		}
+	}
+
+	return Materialize(results.back(), arena, cons);
+}
+
+ASTOptimizeResult ASTOptimizer::Rewrite(CompoundEntity *e, ASTOptimizeResult &l, ASTOptimizeResult &r, ASTArena &arena, ASTHashCons *cons) {
+	TieredEntity::OperatorType op = e->GetOperator();
+
+	if (op >= TieredEntity::ARITHMETIC_ADD && op <= TieredEntity::ARITHMETIC_POW) {
+		if (l.constant && r.constant) {
+			ASTInstruction::OpCode code = (ASTInstruction::OpCode)(ASTInstruction::ARITHMETIC_ADD + (op - TieredEntity::ARITHMETIC_ADD));
+			return { nullptr, ASTCompiler::Apply(code, l.value, r.value), true };
+		}
+
+		// x+0 is not among these, -0+0 gives +0
+		switch (op) {
+		case TieredEntity::ARITHMETIC_ADD:
+			if (IsConstant(r, -0.0))
+				return l;
+			else if (IsConstant(l, -0.0))
+				return r;
+			break;
+		case TieredEntity::ARITHMETIC_SUB:
+			if (IsConstant(r, 0.0))
+				return l;
+			break;
+		case TieredEntity::ARITHMETIC_MUL:
+			if (IsConstant(r, 1.0))
+				return l;
+			else if (IsConstant(l, 1.0))
+				return r;
+			break;
+		case TieredEntity::ARITHMETIC_DIV:
+			if (IsConstant(r, 1.0))
+				return l;
+			break;
+		default:
+			break;
+		}
+	}
+
+	Entity *left = Materialize(l, arena, cons), *right = Materialize(r, arena, cons);
+
+	// whether the target of an assignment is valid depends on its shape
+	if (op == TieredEntity::OPERATOR_SET)
+		left = e->Get(CompoundEntity::LEFT_ENTITY);
+
+	if (left == e->Get(CompoundEntity::LEFT_ENTITY) && right == e->Get(CompoundEntity::RIGHT_ENTITY))
+		return { e, 0, false };
+
+	if (cons != nullptr)
+		return { cons->Compound(arena, op, left, right), 0, false };
+	return { arena.New<CompoundEntity>(op, left, right), 0, false };
+}
+
+// Constants are only turned back into literals where they meet something
+// that is not, so a folded subtree costs a single node.
+Entity* ASTOptimizer::Materialize(ASTOptimizeResult &r, ASTArena &arena, ASTHashCons *cons) {
+	if (r.constant && r.e == nullptr) {
+		char text[32];
+		double abs = fabs(r.value);
+
+		// the sign lives in the entity, so -nan and -0 stay what they were
+		if (isnan(abs))
+			strcpy(text, "nan");
+		else if (isinf(abs))
+			strcpy(text, "inf");
+		else
+			snprintf(text, sizeof(text), "%.17g", abs);
+
+		if (cons != nullptr)
+			r.e = cons->Literal(arena, text, abs, (bool)signbit(r.value));
+		else
+			r.e = arena.New<LiteralEntity>(string(text), abs, (bool)signbit(r.value));
+	}
+
+	return r.e;
+}
+
+// Compares bits, so -0 and +0 are told apart.
+bool ASTOptimizer::IsConstant(const ASTOptimizeResult &r, double v) {
+	return r.constant && memcmp(&r.value, &v, sizeof(double)) == 0;
+}
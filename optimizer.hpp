@@ -0,0 +1,46 @@
+#pragma once
+
+#include "arena.hpp"
+#include "compiler.hpp"
+#include "entities/entities.hpp"
+#include "hashcons.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// A node waiting to be rewritten; `done` is set once its children are.
+struct ASTOptimizeFrame {
+	Entity *e;
+	bool done;
+};
+
+// A rewritten subtree. A constant keeps its value and gets a literal node
+// only when one is needed; `e` is null until then.
+struct ASTOptimizeResult {
+	Entity *e;
+	double value;
+	bool constant;
+};
+
+// Rewrites a parsed tree before it is compiled: constant subtrees become
+// single literals and arithmetic identities are dropped. Every rewrite
+// gives bit-identical results, NaN and infinities included, so x^2 or
+// x^0.5 are left alone: glibc's pow is not correctly rounded and does not
+// always agree with x*x or sqrt(x).
+class ASTOptimizer {
+public:
+	// Unchanged subtrees are shared with `e`; new nodes go into `arena`,
+	// through `cons` when `e` was parsed into a DAG so it stays one.
+	// The work buffers are reused from one call to the next.
+	Entity* Optimize(Entity *e, ASTArena &arena, ASTHashCons *cons=nullptr);
+protected:
+	vector<ASTOptimizeFrame> mFrames;
+	// rewritten children, in the order they were visited
+	vector<ASTOptimizeResult> mResults;
+	vector<Entity*> mArguments;
+
+	static ASTOptimizeResult Rewrite(CompoundEntity *e, ASTOptimizeResult &l, ASTOptimizeResult &r, ASTArena &arena, ASTHashCons *cons);
+	static Entity* Materialize(ASTOptimizeResult &r, ASTArena &arena, ASTHashCons *cons);
+	static bool IsConstant(const ASTOptimizeResult &r, double v);
+};
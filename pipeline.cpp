@@ -0,0 +1,120 @@
+#include "pipeline.hpp"
+
+#include "classifier.hpp"
+
+#include <exception>
+
+using namespace std;
+
+ASTPipeline::ASTPipeline(ASTLineReader &reader, bool hash_consing) : mReader(reader) {
+	mLex.SetHashConsing(hash_consing);
+
+	for (size_t i = 0; i < QUEUE_LENGTH; i++) {
+		mBatches.emplace_back(new ASTPipelineBatch());
+		mBatches.back()->entries.resize(BATCH_LENGTH);
+		mBatches.back()->lines.resize(BATCH_LENGTH);
+	}
+
+	mThread = thread(&ASTPipeline::Parse, this);
+}
+
+bool ASTPipeline::Next(const ASTIncludeEntry *&entry, int &line) {
+	for (;;) {
+		if (mCurrent != nullptr && mIndex < mCurrent->length) {
+			entry = &mCurrent->entries[mIndex];
+			line = mCurrent->lines[mIndex];
+			mIndex++;
+			return true;
+		}
+
+		unique_lock<mutex> guard(mLock);
+
+		// the entries handed out so far are no longer used
+		if (mCurrent != nullptr) {
+			mCurrent = nullptr;
+			mRead++;
+			mFree.notify_one();
+		}
+
+		mReady.wait(guard, [this]() { return mFilled > mRead || mDone; });
+		if (mFilled == mRead)
+			return false;
+
+		mCurrent = mBatches[mRead % mBatches.size()].get();
+		mIndex = 0;
+	}
+}
+
+void ASTPipeline::Stop() {
+	{
+		lock_guard<mutex> guard(mLock);
+		mStopping = true;
+	}
+
+	mFree.notify_one();
+	if (mThread.joinable())
+		mThread.join();
+}
+
+ASTPipeline::~ASTPipeline() {
+	Stop();
+}
+
+// -- MARK: Parser thread
+
+void ASTPipeline::Parse() {
+	for (;;) {
+		ASTPipelineBatch *batch;
+
+		{
+			unique_lock<mutex> guard(mLock);
+			mFree.wait(guard, [this]() { return mStopping || mFilled - mRead < mBatches.size(); });
+			if (mStopping)
+				return;
+			batch = mBatches[mFilled % mBatches.size()].get();
+		}
+
+		Fill(*batch);
+
+		lock_guard<mutex> guard(mLock);
+		mFilled++;
+		mDone = batch->length < BATCH_LENGTH;
+		mReady.notify_one();
+
+		if (mDone)
+			return;
+	}
+}
+
+// Classifies and parses the next lines as LoadInclude does.
+void ASTPipeline::Fill(ASTPipelineBatch &batch) {
+	const char *now;
+	size_t length;
+
+	batch.arena.Reset();
+	batch.length = 0;
+
+	while (batch.length < BATCH_LENGTH && mReader.Next(now, length)) {
+		ASTLine line = ASTClassifier::Classify(now, length);
+		ASTIncludeEntry &entry = batch.entries[batch.length];
+
+		entry.type = line.type;
+		entry.key.assign(now + line.key, line.key_length);
+		entry.e = nullptr;
+		entry.error = nullptr;
+
+		if (line.type == ASTLine::SYMBOL_SET_LINE || line.type == ASTLine::EXPRESSION_LINE) {
+			entry.value.clear();
+			try {
+				entry.e = mLex.Parse(now + line.value, line.value_length, batch.arena);
+			} catch (...) {
+				// thrown again on the interpreter's thread, when the line runs
+				entry.error = current_exception();
+			}
+		} else {
+			entry.value.assign(now + line.value, line.value_length);
+		}
+
+		batch.lines[batch.length++] = mReader.GetLine();
+	}
+}
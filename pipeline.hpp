@@ -0,0 +1,64 @@
+#pragma once
+
+#include "arena.hpp"
+#include "include.hpp"
+#include "lexical.hpp"
+#include "reader.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Lines parsed together, and the arena that owns their entities.
+struct ASTPipelineBatch {
+	vector<ASTIncludeEntry> entries;
+	// the physical line each entry ended on, for error messages
+	vector<int> lines;
+	size_t length = 0;
+	ASTArena arena;
+};
+
+// Classifies and parses the lines of a script on a thread of its own, a
+// bounded number of batches ahead of the interpreter running them (see
+// ASTInterpreter::RunEntry). Parsing an expression reads no interpreter
+// state; directive bodies and includes are parsed when they run, so a line
+// still sees everything the lines before it defined.
+class ASTPipeline {
+public:
+	static const size_t BATCH_LENGTH = 256;
+	static const size_t QUEUE_LENGTH = 8;
+
+	// `reader` must stay open, and is only read from the parser thread.
+	ASTPipeline(ASTLineReader &reader, bool hash_consing=false);
+	// The next line, valid until the following call; false once every
+	// line was handed out.
+	bool Next(const ASTIncludeEntry *&entry, int &line);
+	// Stops parsing; lines not handed out yet are dropped.
+	void Stop();
+	~ASTPipeline();
+protected:
+	ASTLineReader &mReader;
+	ASTLex mLex;
+	// a ring; batch `i` is filled by the parser while `i` < mFilled and
+	// read by the interpreter until mRead passes it
+	vector<unique_ptr<ASTPipelineBatch>> mBatches;
+	size_t mFilled = 0, mRead = 0;
+	bool mDone = false, mStopping = false;
+	mutex mLock;
+	condition_variable mReady, mFree;
+	thread mThread;
+	// the batch being handed out, and its next entry
+	ASTPipelineBatch *mCurrent = nullptr;
+	size_t mIndex = 0;
+
+	void Parse();
+	void Fill(ASTPipelineBatch &batch);
+private:
+	ASTPipeline(const ASTPipeline&) = delete;
+	ASTPipeline& operator=(const ASTPipeline&) = delete;
+};
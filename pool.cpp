@@ -0,0 +1,94 @@
+#include "pool.hpp"
+
+using namespace std;
+
+ASTPool::ASTPool(const shared_ptr<ASTLibrary> &library, size_t threads) : mNext(0) {
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+
+	for (size_t i = 0; i < threads; i++)
+		mInterpreters.emplace_back(new ASTInterpreter(library));
+	Start(threads);
+}
+
+ASTPool::ASTPool(size_t threads) : mNext(0) {
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+
+	Start(threads);
+}
+
+void ASTPool::Start(size_t threads) {
+	for (size_t i = 0; i < threads; i++)
+		mThreads.emplace_back(&ASTPool::Work, this, i);
+}
+
+size_t ASTPool::GetLength() {
+	return mThreads.size();
+}
+
+void ASTPool::Run(size_t count, const Job &job) {
+	mJob = &job;
+	Dispatch(count);
+	mJob = nullptr;
+}
+
+void ASTPool::Run(size_t count, const Task &task) {
+	mTask = &task;
+	Dispatch(count);
+	mTask = nullptr;
+}
+
+// Wakes every worker on the job or task set, and waits for all of them.
+void ASTPool::Dispatch(size_t count) {
+	unique_lock<mutex> guard(mLock);
+
+	mCount = count;
+	mNext = 0;
+	mBusy = mThreads.size();
+	mGeneration++;
+	mWake.notify_all();
+
+	mDone.wait(guard, [this]() { return mBusy == 0; });
+}
+
+void ASTPool::Work(size_t worker) {
+	ASTInterpreter *m = worker < mInterpreters.size() ? mInterpreters[worker].get() : nullptr;
+	size_t generation = 0;
+
+	for (;;) {
+		{
+			unique_lock<mutex> guard(mLock);
+			mWake.wait(guard, [&]() { return mStopping || mGeneration != generation; });
+			if (mStopping)
+				return;
+			generation = mGeneration;
+		}
+
+		for (size_t i = mNext++; i < mCount; i = mNext++) {
+			if (mJob != nullptr)
+				(*mJob)(*m, i);
+			else
+				(*mTask)(i);
+		}
+
+		unique_lock<mutex> guard(mLock);
+		if (--mBusy == 0)
+			mDone.notify_one();
+	}
+}
+
+ASTPool::~ASTPool() {
+	{
+		lock_guard<mutex> guard(mLock);
+		mStopping = true;
+		mWake.notify_all();
+	}
+
+	for (thread &t : mThreads)
+		t.join();
+}
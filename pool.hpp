@@ -0,0 +1,56 @@
+#pragma once
+
+#include "interpreter.hpp"
+#include "library.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Worker threads, each with its own interpreter over one shared library,
+// or none for jobs that bring their own. Run hands out job indices to
+// whichever worker is free; every interpreter keeps its stack and symbols
+// from one job to the next.
+class ASTPool {
+public:
+	typedef function<void(ASTInterpreter&, size_t)> Job;
+	typedef function<void(size_t)> Task;
+
+	// `threads` 0 means one per hardware thread.
+	ASTPool(const shared_ptr<ASTLibrary> &library, size_t threads=0);
+	// Threads alone, for Run with a Task only.
+	explicit ASTPool(size_t threads=0);
+	size_t GetLength();
+	// Calls `job` for every index below `count` and returns once all are
+	// done. Exceptions must not escape `job`.
+	void Run(size_t count, const Job &job);
+	void Run(size_t count, const Task &task);
+	~ASTPool();
+protected:
+	vector<thread> mThreads;
+	vector<unique_ptr<ASTInterpreter>> mInterpreters;
+	mutex mLock;
+	condition_variable mWake, mDone;
+	// bumped by every Run, so a worker knows there is work
+	size_t mGeneration = 0;
+	size_t mBusy = 0;
+	bool mStopping = false;
+	const Job *mJob = nullptr;
+	const Task *mTask = nullptr;
+	size_t mCount = 0;
+	atomic<size_t> mNext;
+
+	void Start(size_t threads);
+	void Dispatch(size_t count);
+	void Work(size_t worker);
+private:
+	ASTPool(const ASTPool&) = delete;
+	ASTPool& operator=(const ASTPool&) = delete;
+};
@@ -0,0 +1,130 @@
+#include "profile.hpp"
+
+#include "names.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+
+ASTProfiler::ASTProfiler() {
+	mNodes.push_back({0, 0, 0});
+}
+
+void ASTProfiler::Enter(unsigned id) {
+	unsigned parent = mFrames.empty() ? 0 : mFrames.back().node;
+
+	if (id >= mEntries.size())
+		mEntries.resize(id + 1);
+
+	ASTProfileEntry &e = mEntries[id];
+	e.calls++;
+	if (++e.active > e.depth)
+		e.depth = e.active;
+
+	mFrames.push_back({GetChild(parent, id), Clock::now(), 0});
+}
+
+void ASTProfiler::Leave() {
+	Frame f = mFrames.back();
+	double elapsed = chrono::duration<double>(Clock::now() - f.begin).count();
+	Node &n = mNodes[f.node];
+	ASTProfileEntry &e = mEntries[n.id];
+
+	mFrames.pop_back();
+
+	n.self += elapsed - f.children;
+	e.self += elapsed - f.children;
+	if (--e.active == 0)
+		e.inclusive += elapsed;
+
+	if (!mFrames.empty())
+		mFrames.back().children += elapsed;
+}
+
+unsigned ASTProfiler::GetChild(unsigned parent, unsigned id) {
+	uint64_t key = (uint64_t)parent << 32 | id;
+	unordered_map<uint64_t, unsigned>::iterator it = mChildren.find(key);
+
+	if (it != mChildren.end())
+		return it->second;
+
+	mNodes.push_back({parent, id, 0});
+	mChildren[key] = mNodes.size() - 1;
+	return mNodes.size() - 1;
+}
+
+void ASTProfiler::Merge(const ASTProfiler &other) {
+	// parents always come before their children
+	vector<unsigned> map(other.mNodes.size(), 0);
+
+	for (size_t i = 1; i < other.mNodes.size(); i++) {
+		const Node &n = other.mNodes[i];
+		map[i] = GetChild(map[n.parent], n.id);
+		mNodes[map[i]].self += n.self;
+	}
+
+	if (other.mEntries.size() > mEntries.size())
+		mEntries.resize(other.mEntries.size());
+
+	for (size_t i = 0; i < other.mEntries.size(); i++) {
+		const ASTProfileEntry &o = other.mEntries[i];
+		ASTProfileEntry &e = mEntries[i];
+
+		e.calls += o.calls;
+		e.inclusive += o.inclusive;
+		e.self += o.self;
+		e.depth = max(e.depth, o.depth);
+	}
+}
+
+void ASTProfiler::Print(ostream &out) {
+	vector<unsigned> ids;
+	char line[256];
+
+	for (size_t i = 0; i < mEntries.size(); i++) {
+		if (mEntries[i].calls > 0)
+			ids.push_back(i);
+	}
+
+	sort(ids.begin(), ids.end(), [this](unsigned a, unsigned b) {
+		if (mEntries[a].self != mEntries[b].self)
+			return mEntries[a].self > mEntries[b].self;
+		return ASTNameTable::GetName(a) < ASTNameTable::GetName(b);
+	});
+
+	out << "PROFILE---" << endl;
+	snprintf(line, sizeof(line), "%-24s %12s %14s %14s %6s", "directive", "calls", "inclusive ms", "self ms", "depth");
+	out << line << endl;
+
+	for (unsigned id : ids) {
+		const ASTProfileEntry &e = mEntries[id];
+
+		snprintf(line, sizeof(line), "%-24s %12zu %14.3f %14.3f %6u", ASTNameTable::GetName(id).c_str(),
+				 e.calls, e.inclusive * 1e3, e.self * 1e3, e.depth);
+		out << line << endl;
+	}
+}
+
+bool ASTProfiler::WriteStacks(const string &path) {
+	ofstream fp(path);
+	vector<string> stacks(mNodes.size());
+
+	if (!fp.is_open())
+		return false;
+
+	for (size_t i = 1; i < mNodes.size(); i++) {
+		const Node &n = mNodes[i];
+
+		stacks[i] = n.parent == 0 ? ASTNameTable::GetName(n.id) : stacks[n.parent] + ";" + ASTNameTable::GetName(n.id);
+		if (n.self > 0)
+			fp << stacks[i] << " " << (long long)(n.self * 1e9) << "\n";
+	}
+
+	return fp.good();
+}
+
+const ASTProfileEntry* ASTProfiler::GetEntry(unsigned id) {
+	return id < mEntries.size() && mEntries[id].calls > 0 ? &mEntries[id] : nullptr;
+}
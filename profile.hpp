@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Per directive totals of an ASTProfiler.
+struct ASTProfileEntry {
+	size_t calls = 0;
+	// seconds; a recursive call only counts towards the outermost one
+	double inclusive = 0;
+	double self = 0;
+	// calls of the directive active at once
+	unsigned depth = 0;
+	unsigned active = 0;
+};
+
+// Times every directive call, and every distinct stack of calls for
+// flame graphs. Calls must nest: each Enter is matched by one Leave.
+class ASTProfiler {
+public:
+	ASTProfiler();
+	void Enter(unsigned id);
+	void Leave();
+	// Adds the totals and stacks of `other`, which must not be running.
+	void Merge(const ASTProfiler &other);
+	// The directives by self time, slowest first.
+	void Print(ostream &out);
+	// One line per stack, "a;b;c nanoseconds", as flamegraph.pl reads.
+	bool WriteStacks(const string &path);
+	const ASTProfileEntry* GetEntry(unsigned id);
+protected:
+	typedef chrono::steady_clock Clock;
+
+	// a node of the tree of call stacks, 0 is the root
+	struct Node {
+		unsigned parent;
+		unsigned id;
+		double self;
+	};
+
+	struct Frame {
+		unsigned node;
+		Clock::time_point begin;
+		// spent in the calls made from this one
+		double children;
+	};
+
+	vector<ASTProfileEntry> mEntries;
+	vector<Node> mNodes;
+	// (parent << 32 | id) to node
+	unordered_map<uint64_t, unsigned> mChildren;
+	vector<Frame> mFrames;
+
+	unsigned GetChild(unsigned parent, unsigned id);
+};
+
+// Enters a call for as long as it lives, also when left by an exception.
+class ASTProfileScope {
+public:
+	ASTProfileScope(ASTProfiler *profiler, unsigned id) : mProfiler(profiler) {
+		if (mProfiler != nullptr)
+			mProfiler->Enter(id);
+	}
+
+	~ASTProfileScope() {
+		if (mProfiler != nullptr)
+			mProfiler->Leave();
+	}
+private:
+	ASTProfiler *mProfiler;
+};
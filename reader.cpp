@@ -0,0 +1,120 @@
+#include "reader.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AST_MMAP_READER
+#endif
+
+using namespace std;
+
+ASTLineReader::ASTLineReader() {}
+
+bool ASTLineReader::Open(const string &path) {
+	Close();
+
+#ifdef AST_MMAP_READER
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+		// fault the whole file in at once, rather than a page at a time
+		flags |= MAP_POPULATE;
+#endif
+		void *p = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+
+		if (p != MAP_FAILED) {
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			close(fd);
+			mMap = p;
+			mData = (const char*)p;
+			mLength = st.st_size;
+			return true;
+		}
+	}
+
+	close(fd);
+#endif
+
+	ifstream fp(path, ios::binary);
+	if (!fp.is_open())
+		return false;
+
+	mBuffer.assign(istreambuf_iterator<char>(fp), istreambuf_iterator<char>());
+	mData = mBuffer.data();
+	mLength = mBuffer.length();
+	return true;
+}
+
+bool ASTLineReader::ReadLine(const char *&line, size_t &length) {
+	if (mOffset >= mLength)
+		return false;
+
+	const char *b = mData + mOffset;
+	const char *nl = (const char*)memchr(b, '\n', mLength - mOffset);
+
+	line = b;
+	length = nl != nullptr ? nl - b : mLength - mOffset;
+	mOffset += length + (nl != nullptr);
+	mLine++;
+	return true;
+}
+
+bool ASTLineReader::Next(const char *&line, size_t &length) {
+	const char *now;
+	size_t n;
+
+	mJoined.clear();
+
+	// a pending continuation at the end of the file is dropped
+	while (ReadLine(now, n)) {
+		// a line continues when its first backslash is its last character
+		if (n == 0 || (now[n - 1] == '\\' && memchr(now, '\\', n - 1) == nullptr)) {
+			mJoined.append(now, n == 0 ? 0 : n - 1);
+		} else if (mJoined.empty()) {
+			line = now;
+			length = n;
+			return true;
+		} else {
+			mJoined.append(now, n);
+			line = mJoined.data();
+			length = mJoined.length();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int ASTLineReader::GetLine() {
+	return mLine;
+}
+
+void ASTLineReader::Close() {
+#ifdef AST_MMAP_READER
+	if (mMap != nullptr)
+		munmap(mMap, mLength);
+#endif
+
+	mMap = nullptr;
+	mData = nullptr;
+	mLength = mOffset = 0;
+	mBuffer.clear();
+	mJoined.clear();
+	mLine = 0;
+}
+
+ASTLineReader::~ASTLineReader() {
+	Close();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Reads a script file as line views, without copying. Regular files are
+// mapped; anything else (a pipe, a terminal) is read whole first. A line
+// holds no terminator and stays valid until the next call; the file data
+// itself stays valid until Close.
+class ASTLineReader {
+public:
+	ASTLineReader();
+	// False when `path` cannot be opened.
+	bool Open(const string &path);
+	// The next physical line.
+	bool ReadLine(const char *&line, size_t &length);
+	// The next logical line: lines ending in their only backslash are
+	// joined to the next one without it, and empty lines are skipped, as
+	// the interpreter always did. Only joined lines are copied.
+	bool Next(const char *&line, size_t &length);
+	// The number of the last physical line read, from 1.
+	int GetLine();
+	void Close();
+	~ASTLineReader();
+protected:
+	const char *mData = nullptr;
+	size_t mLength = 0, mOffset = 0;
+	// the mapping, or the whole file when it could not be mapped
+	void *mMap = nullptr;
+	string mBuffer;
+	// the parts of a line with continuations
+	string mJoined;
+	int mLine = 0;
+private:
+	ASTLineReader(const ASTLineReader&) = delete;
+	ASTLineReader& operator=(const ASTLineReader&) = delete;
+};
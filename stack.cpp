@@ -0,0 +1,26 @@
+#include "stack.hpp"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+ASTValueStack::ASTValueStack() {}
+
+void ASTValueStack::Grow(size_t n) {
+	size_t capacity = mCapacity ? mCapacity : 16;
+
+	while (capacity < n)
+		capacity *= 2;
+
+	double *data = (double*)realloc(mData, capacity * sizeof(double));
+	if (data == nullptr)
+		throw bad_alloc();
+
+	mData = data;
+	mCapacity = capacity;
+}
+
+ASTValueStack::~ASTValueStack() {
+	free(mData);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+
+using namespace std;
+
+// The interpreter stack: values in one block that only grows. Nothing here
+// checks for underflow, callers check IsEmpty where it can happen; the
+// unchecked pushes need room made by Reserve first.
+class ASTValueStack {
+public:
+	ASTValueStack();
+
+	bool IsEmpty() const {
+		return mLength == 0;
+	}
+
+	size_t GetLength() const {
+		return mLength;
+	}
+
+	double Top() const {
+		return mData[mLength - 1];
+	}
+
+	void Push(double v) {
+		if (mLength == mCapacity)
+			Grow(mLength + 1);
+		mData[mLength++] = v;
+	}
+
+	// Room for `n` more values without growing.
+	void Reserve(size_t n) {
+		if (mCapacity - mLength < n)
+			Grow(mLength + n);
+	}
+
+	void PushUnchecked(double v) {
+		mData[mLength++] = v;
+	}
+
+	double Pop() {
+		return mData[--mLength];
+	}
+
+	// The top `n` values in place, the top one last.
+	const double* Peek(size_t n) const {
+		return mData + mLength - n;
+	}
+
+	void Drop(size_t n) {
+		mLength -= n;
+	}
+
+	~ASTValueStack();
+protected:
+	double *mData = nullptr;
+	size_t mLength = 0, mCapacity = 0;
+
+	void Grow(size_t n);
+private:
+	ASTValueStack(const ASTValueStack&) = delete;
+	ASTValueStack& operator=(const ASTValueStack&) = delete;
+};
@@ -0,0 +1,19 @@
+# cmake -DAST_YET=<ast_yet> -DEMITTED=<program> -DSCRIPT=<script> "-DOPTIONS=<a;b>" -P emitted.cmake
+#
+# Checks a program built from `ast_yet -emit-cpp` prints what ast_yet
+# prints running the same script.
+
+execute_process(COMMAND ${AST_YET} ${OPTIONS} ${SCRIPT} OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "ast_yet ${SCRIPT} failed: ${result}")
+endif()
+
+execute_process(COMMAND ${EMITTED} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "${EMITTED} failed: ${result}")
+endif()
+
+message("${output}")
+if(NOT output STREQUAL expected)
+	message(FATAL_ERROR "ast_yet prints instead:\n${expected}")
+endif()
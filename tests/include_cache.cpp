@@ -0,0 +1,66 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "exceptions.hpp"
+#include "interpreter.hpp"
+
+using namespace std;
+
+// Includes a file three times on one interpreter, rewriting it before the
+// last: the cached lines serve the second include, the new ones the third.
+// Usage: ast_yet_include_cache <scratch file>
+
+static bool Write(const string &path, const string &text) {
+	ofstream out(path, ios::trunc);
+	out << text;
+	return (bool)out;
+}
+
+static bool Expect(ASTInterpreter &m, const string &include, double expected) {
+	m.Run(include);
+
+	double r = m.GetSymbol("N");
+	if (r != expected) {
+		cout << "N is " << r << " after " << include << ", expected " << expected << endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		cout << "usage: " << argv[0] << " <scratch file>" << endl;
+		return 2;
+	}
+
+	const string path = argv[1], include = "@[!" + path + "]";
+	ASTInterpreter m;
+
+	try {
+		if (!Write(path, "@N=N+1\n")) {
+			cout << "Cannot write file " << path << endl;
+			return 1;
+		}
+
+		m.Run("@N=0");
+		if (!Expect(m, include, 1) || !Expect(m, include, 2))
+			return 1;
+
+		// another size, so it differs even where mtimes are coarse
+		if (!Write(path, "@N=N+100\n")) {
+			cout << "Cannot write file " << path << endl;
+			return 1;
+		}
+
+		if (!Expect(m, include, 102))
+			return 1;
+	} catch (const ASTException &ex) {
+		cout << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	cout << "OK" << endl;
+	return 0;
+}
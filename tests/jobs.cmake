@@ -0,0 +1,31 @@
+# cmake -DAST_YET=<ast_yet> -DJOBS=<n> -DFILES=<a;b> -P jobs.cmake
+#
+# Checks the test files pass, that a run on JOBS threads reports what a
+# serial run does, timings aside, and that -verbose reports each case right
+# after its trace.
+
+function(run_tests out)
+	execute_process(COMMAND ${AST_YET} -test ${ARGN} ${FILES} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "ast_yet -test ${ARGN} failed: ${result}")
+	endif()
+
+	string(REGEX REPLACE "(TIME|SLOW)[^\n]*\n" "" output "${output}")
+	string(REGEX REPLACE " in [0-9.e+-]+ ms" "" output "${output}")
+	set(${out} "${output}" PARENT_SCOPE)
+endfunction()
+
+run_tests(serial -jobs 1)
+run_tests(parallel -jobs ${JOBS})
+run_tests(verbose -verbose -jobs ${JOBS})
+
+message("${serial}")
+if(serial MATCHES "(^|\n)(MIS|ERR) \\[")
+	message(FATAL_ERROR "test cases failed")
+endif()
+if(NOT serial STREQUAL parallel)
+	message(FATAL_ERROR "-jobs ${JOBS} reports otherwise:\n${parallel}")
+endif()
+if(NOT verbose MATCHES "AST stack_pop [^\n]*\nOK  \\[" OR verbose MATCHES "FILE [^\n]*\n(OK |MIS|ERR) ")
+	message(FATAL_ERROR "-verbose reports cases apart from their traces:\n${verbose}")
+endif()
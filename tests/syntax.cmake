@@ -0,0 +1,14 @@
+# cmake -DAST_YET=<ast_yet> -DINPUT=<lines> -DEXPECTED=<output> -P syntax.cmake
+#
+# Feeds malformed lines to the prompt and checks each reports the syntax
+# error it always has.
+
+execute_process(COMMAND ${AST_YET} INPUT_FILE ${INPUT} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "ast_yet failed: ${result}")
+endif()
+
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+	message(FATAL_ERROR "syntax errors differ, got:\n${output}\nexpected:\n${expected}")
+endif()
@@ -0,0 +1,143 @@
+#include "tokenizer.hpp"
+
+#include "number.hpp"
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+ASTTokenizer::ASTTokenizer() {}
+
+ASTTokenizer::ASTTokenizer(const string &code, char separator) {
+	Tokenize(code.data(), code.length(), separator);
+}
+
+size_t ASTTokenizer::GetLength() {
+	return mTokens.size();
+}
+
+const ASTToken& ASTTokenizer::Get(size_t i) {
+	return mTokens[i];
+}
+
+const char* ASTTokenizer::GetData(const ASTToken &t) {
+	return (t.pooled ? mPool.data() : mCode) + t.offset;
+}
+
+string ASTTokenizer::GetText(const ASTToken &t) {
+	return string(GetData(t), t.length);
+}
+
+bool ASTTokenizer::TextEquals(const ASTToken &t, const char *s) {
+	return strlen(s) == t.length && memcmp(GetData(t), s, t.length) == 0;
+}
+
+bool ASTTokenizer::IsWhitespace(char c, char separator) {
+	return c != separator && ASTClassifier::Is(c, ASTClassifier::BLANK_CLASS);
+}
+
+bool ASTTokenizer::IsDelimiter(char c, char separator) {
+	return c == separator || ASTClassifier::Is(c, ASTClassifier::DELIMITER_CLASS);
+}
+
+// -- MARK: Tokenization
+
+// Tokenizes `code`, reusing the buffers of the previous call. The code must
+// outlive the tokens.
+void ASTTokenizer::Tokenize(const char *code, size_t n, char separator) {
+	size_t i = 0;
+
+	mCode = code;
+	mLength = n;
+	mSeparator = separator;
+	mTokens.clear();
+	mPool.clear();
+
+	while (i < n) {
+		char c = mCode[i];
+		ASTToken t;
+		t.op = TieredEntity::OPERATOR_INVALID;
+		t.offset = i;
+		t.length = 1;
+		t.pooled = false;
+		t.number = 0;
+
+		if (c == mSeparator) {
+			t.type = ASTToken::SEPARATOR_TOKEN;
+		} else if (IsWhitespace(c, mSeparator)) {
+			i++;
+			continue;
+		} else if (c == '(') {
+			t.type = ASTToken::OPEN_TOKEN;
+		} else if (c == ')') {
+			t.type = ASTToken::CLOSE_TOKEN;
+		} else if (c == ';') {
+			t.type = ASTToken::ARGUMENT_TOKEN;
+		} else if ((t.op = TieredEntity::OPERATOR(c)) != TieredEntity::OPERATOR_INVALID) {
+			t.type = ASTToken::OPERATOR_TOKEN;
+		} else {
+			// words ignore any whitespace in between, so "1 2" reads as "12"
+			size_t begin = i, end = i, next;
+			bool pooled = false;
+			size_t pool_begin = mPool.size();
+
+			for (;;) {
+				while (end < n && !IsDelimiter(mCode[end], mSeparator))
+					end++;
+
+				next = end;
+				while (next < n && IsWhitespace(mCode[next], mSeparator))
+					next++;
+
+				if (next < n && next != end && !IsDelimiter(mCode[next], mSeparator)) {
+					mPool.append(mCode + begin, end - begin);
+					pooled = true;
+					begin = end = next;
+				} else {
+					break;
+				}
+			}
+
+			if (pooled) {
+				mPool.append(mCode + begin, end - begin);
+				PushWord(pool_begin, mPool.size(), true);
+				mPool.push_back('\0');
+			} else {
+				PushWord(begin, end, false);
+			}
+
+			i = end;
+			continue;
+		}
+
+		mTokens.push_back(t);
+		i++;
+	}
+}
+
+void ASTTokenizer::PushWord(size_t begin, size_t end, bool pooled) {
+	const char *s = (pooled ? mPool.data() : mCode) + begin;
+	const size_t len = end - begin;
+	ASTToken t;
+
+	t.type = ASTToken::INVALID_TOKEN;
+	t.op = TieredEntity::OPERATOR_INVALID;
+	t.offset = begin;
+	t.length = len;
+	t.pooled = pooled;
+	t.number = 0;
+
+	if (ASTClassifier::IsConstant(s, len)) {
+		t.type = ASTToken::CONSTANT_TOKEN;
+		t.number = s[0] == 'i' ? INFINITY : NAN;
+	} else if (ASTClassifier::IsIdentifier(s, len)) {
+		t.type = ASTToken::IDENTIFIER_TOKEN;
+	} else if (ASTClassifier::IsNumber(s, len)) {
+		// the word is always followed by a delimiter or a terminator
+		t.type = ASTToken::NUMBER_TOKEN;
+		ASTNumber::Decode(s, len, t.number);
+	}
+
+	mTokens.push_back(t);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "classifier.hpp"
+#include "entities/entities.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct ASTToken {
+	typedef enum {
+		INVALID_TOKEN = -1,
+		IDENTIFIER_TOKEN,
+		NUMBER_TOKEN,
+		CONSTANT_TOKEN,
+		OPERATOR_TOKEN,
+		OPEN_TOKEN,
+		CLOSE_TOKEN,
+		ARGUMENT_TOKEN,
+		SEPARATOR_TOKEN,
+	} TokenType;
+
+	TokenType type;
+	TieredEntity::OperatorType op;
+	// span in the source buffer, or in the tokenizer pool when `pooled`
+	uint32_t offset, length;
+	bool pooled;
+	double number;
+};
+
+class ASTTokenizer {
+public:
+	ASTTokenizer();
+	ASTTokenizer(const string &code, char separator='\n');
+	void Tokenize(const char *code, size_t n, char separator='\n');
+	size_t GetLength();
+	const ASTToken& Get(size_t i);
+	const char* GetData(const ASTToken &t);
+	string GetText(const ASTToken &t);
+	bool TextEquals(const ASTToken &t, const char *s);
+	static bool IsWhitespace(char c, char separator='\n');
+	static bool IsDelimiter(char c, char separator='\n');
+protected:
+	void PushWord(size_t begin, size_t end, bool pooled);
+private:
+	const char *mCode = nullptr;
+	size_t mLength = 0;
+	char mSeparator = '\n';
+	string mPool;
+	vector<ASTToken> mTokens;
+};
@@ -0,0 +1,153 @@
+#include "trace.hpp"
+
+#include "compiler.hpp"
+#include "names.hpp"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+// -- MARK: Sink
+
+ASTTraceSink::ASTTraceSink() : mBegin(chrono::steady_clock::now()) {}
+
+bool ASTTraceSink::Open(const string &path) {
+	Close();
+	mFile = fopen(path.c_str(), "w");
+	return mFile != nullptr;
+}
+
+void ASTTraceSink::Write(const string &block) {
+	lock_guard<mutex> lock(mMutex);
+
+	if (mFile != nullptr)
+		fwrite(block.data(), 1, block.length(), mFile);
+}
+
+chrono::steady_clock::time_point ASTTraceSink::GetBegin() {
+	return mBegin;
+}
+
+void ASTTraceSink::Close() {
+	lock_guard<mutex> lock(mMutex);
+
+	if (mFile != nullptr)
+		fclose(mFile);
+	mFile = nullptr;
+}
+
+ASTTraceSink::~ASTTraceSink() {
+	Close();
+}
+
+// -- MARK: Tracer
+
+void ASTTracer::SetVerbose(bool verbose) {
+	mVerbose = verbose;
+}
+
+bool ASTTracer::GetVerbose() {
+	return mVerbose;
+}
+
+void ASTTracer::SetSink(const shared_ptr<ASTTraceSink> &sink) {
+	Flush();
+	mSink = sink;
+}
+
+bool ASTTracer::IsEnabled() {
+	return mVerbose || mSink != nullptr;
+}
+
+void ASTTracer::Event(EventType type, unsigned name, double value) {
+	if (mVerbose)
+		Print(type, name, value);
+
+	if (mSink != nullptr) {
+		Append(type, name, value);
+		if (mBuffer.length() >= BUFFER_SIZE)
+			Flush();
+	}
+}
+
+void ASTTracer::Flush() {
+	if (mSink != nullptr && !mBuffer.empty())
+		mSink->Write(mBuffer);
+	mBuffer.clear();
+}
+
+const char* ASTTracer::GetEventString(EventType type) {
+	switch (type) {
+	case RESULT_EVENT:
+		return "result";
+	case OPERATION_EVENT:
+		return "operation";
+	case MEMO_HIT_EVENT:
+		return "memo_hit";
+	case FRAME_EVENT:
+		return "frame";
+	case GET_SYMBOL_EVENT:
+		return "get_symbol";
+	case SET_SYMBOL_EVENT:
+		return "set_symbol";
+	case CALL_EVENT:
+		return "call_directive";
+	case STACK_PUSH_EVENT:
+		return "stack_push";
+	case STACK_POP_EVENT:
+		return "stack_pop";
+	default:
+		return "invalid";
+	}
+}
+
+// The lines the interpreter always printed in verbose mode.
+void ASTTracer::Print(EventType type, unsigned name, double value) {
+	switch (type) {
+	case RESULT_EVENT:
+		cout << "RES " << value << '\n';
+		break;
+	case OPERATION_EVENT:
+		cout << "AST op " << ASTCompiler::GetOpCodeString((ASTInstruction::OpCode)name) << '\n';
+		break;
+	case FRAME_EVENT:
+		cout << "AST function_stack_push" << '\n';
+		break;
+	case SET_SYMBOL_EVENT:
+		cout << "AST set_symbol " << ASTNameTable::GetName(name) << "=" << value << '\n';
+		break;
+	case STACK_PUSH_EVENT:
+	case STACK_POP_EVENT:
+		cout << "AST " << GetEventString(type) << " " << value << '\n';
+		break;
+	default:
+		cout << "AST " << GetEventString(type) << " " << ASTNameTable::GetName(name) << '\n';
+		break;
+	}
+}
+
+void ASTTracer::Append(EventType type, unsigned name, double value) {
+	long long ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - mSink->GetBegin()).count();
+	char line[64];
+
+	snprintf(line, sizeof(line), "{\"t\":%lld,\"event\":\"%s\",\"node\":\"", ns, GetEventString(type));
+	mBuffer += line;
+
+	if (type == OPERATION_EVENT)
+		mBuffer += ASTCompiler::GetOpCodeString((ASTInstruction::OpCode)name);
+	else if (type != RESULT_EVENT && type != FRAME_EVENT && type != STACK_PUSH_EVENT && type != STACK_POP_EVENT)
+		// names are identifiers, nothing to escape
+		mBuffer += ASTNameTable::GetName(name);
+
+	// JSON has no NaN or infinities
+	if (isfinite(value))
+		snprintf(line, sizeof(line), "\",\"value\":%.17g}\n", value);
+	else
+		snprintf(line, sizeof(line), "\",\"value\":\"%s\"}\n", isnan(value) ? "nan" : value > 0 ? "inf" : "-inf");
+	mBuffer += line;
+}
+
+ASTTracer::~ASTTracer() {
+	Flush();
+}
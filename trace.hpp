@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+// Tracing policies of the evaluator. Every trace call sits behind
+// `Trace::enabled`, so the ASTNoTracing instantiation has no tracing code.
+struct ASTNoTracing {
+	static const bool enabled = false;
+};
+
+struct ASTTracing {
+	static const bool enabled = true;
+};
+
+// A file of JSON lines shared by any number of tracers. Each tracer
+// buffers its own lines and writes them in whole blocks.
+class ASTTraceSink {
+public:
+	ASTTraceSink();
+	// False when `path` cannot be created.
+	bool Open(const string &path);
+	void Write(const string &block);
+	// when the sink was created, the time of every event is relative to it
+	chrono::steady_clock::time_point GetBegin();
+	void Close();
+	~ASTTraceSink();
+protected:
+	FILE *mFile = nullptr;
+	mutex mMutex;
+	chrono::steady_clock::time_point mBegin;
+private:
+	ASTTraceSink(const ASTTraceSink&) = delete;
+	ASTTraceSink& operator=(const ASTTraceSink&) = delete;
+};
+
+// Receives the events of one interpreter: printed as the verbose trace,
+// and written to a sink as `{"t":ns,"event":...,"node":...,"value":...}`.
+class ASTTracer {
+public:
+	typedef enum {
+		RESULT_EVENT,
+		// `name` is the ASTInstruction::OpCode
+		OPERATION_EVENT,
+		MEMO_HIT_EVENT,
+		FRAME_EVENT,
+		GET_SYMBOL_EVENT,
+		SET_SYMBOL_EVENT,
+		CALL_EVENT,
+		STACK_PUSH_EVENT,
+		STACK_POP_EVENT,
+	} EventType;
+
+	static const size_t BUFFER_SIZE = 1 << 16;
+
+	void SetVerbose(bool verbose);
+	bool GetVerbose();
+	void SetSink(const shared_ptr<ASTTraceSink> &sink);
+	// whether events go anywhere, the evaluator is picked from this
+	bool IsEnabled();
+	void Event(EventType type, unsigned name=0, double value=0);
+	void Flush();
+	static const char* GetEventString(EventType type);
+	~ASTTracer();
+protected:
+	bool mVerbose = false;
+	shared_ptr<ASTTraceSink> mSink;
+	string mBuffer;
+
+	void Print(EventType type, unsigned name, double value);
+	void Append(EventType type, unsigned name, double value);
+};
@@ -0,0 +1,948 @@
+#include "transpiler.hpp"
+
+#include "entities/entities.hpp"
+#include "exceptions.hpp"
+#include "names.hpp"
+#include "number.hpp"
+#include "reader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Test files are cut into shards at this line, as in ast.cpp.
+static const char *sResetMarker = "#reset";
+
+// The interpreter would recurse until it crashed.
+static const size_t MAX_INCLUDE_DEPTH = 64;
+
+ASTTranspiler::ASTTranspiler() {}
+
+void ASTTranspiler::SetOptimize(bool optimize) {
+	mOptimize = optimize;
+}
+
+bool ASTTranspiler::GetOptimize() {
+	return mOptimize;
+}
+
+// -- MARK: Reading
+
+bool ASTTranspiler::AddScript(const string &path) {
+	ASTLineReader reader;
+	const char *now;
+	size_t length;
+
+	if (!reader.Open(path))
+		return false;
+
+	mFiles.push_back(ASTEmitFile());
+	mFiles.back().path = path;
+	mFiles.back().shards.push_back(ASTEmitShard());
+
+	ASTEmitShard &shard = mFiles.back().shards.back();
+	while (reader.Next(now, length)) {
+		shard.units.push_back(ASTEmitUnit());
+		shard.units.back().line = reader.GetLine();
+		Expand(now, length, shard.units.back().entries, shard);
+	}
+
+	return true;
+}
+
+bool ASTTranspiler::AddTests(const string &path) {
+	const size_t marker = strlen(sResetMarker);
+	ASTLineReader reader;
+	const char *now;
+	size_t length;
+	string input;
+
+	if (!reader.Open(path))
+		return false;
+
+	mTests = true;
+	mFiles.push_back(ASTEmitFile());
+	mFiles.back().path = path;
+	mFiles.back().shards.push_back(ASTEmitShard());
+
+	while (reader.ReadLine(now, length)) {
+		if (length == marker && memcmp(now, sResetMarker, marker) == 0) {
+			mFiles.back().shards.push_back(ASTEmitShard());
+			// a case continued up to the marker is never run
+			input.clear();
+			continue;
+		}
+
+		// joined as RunTestShard joins them, empty lines included
+		string line(now, length);
+		if (line.find('\\') == line.length() - 1) {
+			input += line.substr(0, line.length() - 1);
+			continue;
+		}
+
+		input += line;
+		AddCase(input, reader.GetLine(), mFiles.back().shards.back());
+		input.clear();
+	}
+
+	return true;
+}
+
+void ASTTranspiler::AddCase(const string &input, int line, ASTEmitShard &shard) {
+	shard.units.push_back(ASTEmitUnit());
+	ASTEmitUnit &unit = shard.units.back();
+	size_t p = input.find(',');
+	double o;
+
+	unit.line = line;
+	unit.input = input;
+	unit.postfix = GetPostfix(nullptr);
+
+	if (p == string::npos || p == input.length() - 1) {
+		unit.expect = MALFORMED_CASE;
+		return;
+	}
+
+	unit.output = input.substr(p + 1);
+	unit.input = input.substr(0, p);
+
+	if (unit.output == "ERROR") {
+		unit.expect = ERROR_EXPECTED;
+	} else if (unit.output == "IGNORE") {
+		unit.expect = NOTHING_EXPECTED;
+	} else if (ASTNumber::Scan(unit.output.data(), unit.output.length(), o) == 0) {
+		unit.expect = UNPARSABLE_CASE;
+	} else {
+		unit.expect = VALUE_EXPECTED;
+		unit.expected = o;
+	}
+
+	Expand(unit.input.data(), unit.input.length(), unit.entries, shard, &unit.postfix);
+}
+
+// Classifies and compiles a line as Run would, and the lines of what it
+// includes after it. Whatever Run would throw is kept for when it runs.
+void ASTTranspiler::Expand(const char *s, size_t n, vector<ASTEmitEntry> &entries, ASTEmitShard &shard, string *postfix) {
+	ASTLine line = ASTClassifier::Classify(s, n);
+	string value(s + line.value, line.value_length);
+	const size_t at = entries.size();
+
+	entries.push_back(ASTEmitEntry());
+	entries[at].type = line.type;
+	entries[at].key.assign(s + line.key, line.key_length);
+
+	mArena.Reset();
+	if (mHashConsing)
+		mHashCons.Clear();
+
+	try {
+		switch (line.type) {
+		case ASTLine::DIRECTIVE_SET_LINE: {
+			if (!ASTClassifier::IsIdentifier(entries[at].key))
+				throw ASTNotFound("invalid directive name " + entries[at].key);
+
+			unsigned id = ASTNameTable::Intern(entries[at].key);
+			if (ASTCallSite::GetBuiltin(id) != ASTCallSite::NO_BUILTIN)
+				throw ASTInvalidOperation("assignment to a reserved directive");
+
+			entries[at].empty = value.empty();
+			if (!value.empty())
+				CompileInto(Parse(value, mArena), entries[at]);
+			shard.definitions[id]++;
+			break;
+		}
+		case ASTLine::SYMBOL_SET_LINE:
+			CompileInto(Parse(value, mArena), entries[at]);
+			break;
+		case ASTLine::EXPRESSION_LINE: {
+			Entity *e = Parse(value, mArena);
+
+			if (postfix != nullptr)
+				*postfix = GetPostfix(e);
+			CompileInto(e, entries[at]);
+			break;
+		}
+		case ASTLine::INCLUDE_LINE:
+		case ASTLine::INCLUDE_ONCE_LINE: {
+			ASTIncludeKey key;
+			ASTLineReader reader;
+			const char *now;
+			size_t length;
+
+			if (!ASTIncludeCache::GetKey(value, key))
+				throw ASTException("cannot open file \"" + value + "\"");
+
+			entries[at].path = key.path;
+			// the file is being included, so it is skipped for sure
+			if (line.type == ASTLine::INCLUDE_ONCE_LINE && find(mIncluding.begin(), mIncluding.end(), key.path) != mIncluding.end())
+				break;
+			if (mIncluding.size() >= MAX_INCLUDE_DEPTH)
+				throw ASTException("includes nested too deeply");
+			if (!reader.Open(key.path))
+				throw ASTException("cannot open file \"" + value + "\"");
+
+			mIncluding.push_back(key.path);
+			while (reader.Next(now, length))
+				Expand(now, length, entries[at].included, shard);
+			mIncluding.pop_back();
+			break;
+		}
+		case ASTLine::INVALID_DIRECTIVE_LINE:
+			throw ASTSyntaxError("invalid directive syntax");
+		case ASTLine::COMMENT_LINE:
+		default:
+			break;
+		}
+	} catch (const ASTException &ex) {
+		entries[at].error = ex.what();
+	}
+}
+
+void ASTTranspiler::CompileInto(Entity *e, ASTEmitEntry &entry) {
+	ASTHashCons *cons = mHashConsing ? &mHashCons : nullptr;
+
+	mCompiler.Compile(mOptimize ? mOptimizer.Optimize(e, mArena, cons) : e, entry.program, mHashConsing);
+}
+
+// -- MARK: Writing
+
+static const char *sPrelude = R"(#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct ASTError {
+	const char *message;
+
+	const char* what() const {
+		return message;
+	}
+};
+
+[[noreturn]] void Raise(const char *message) {
+	throw ASTError{message};
+}
+
+// The interpreter stack, wherever it could not be resolved ahead.
+vector<double> S;
+
+inline void Push(double v) {
+	S.push_back(v);
+}
+
+inline double Pop() {
+	if (S.empty())
+		Raise("stack is empty");
+
+	double v = S.back();
+	S.pop_back();
+	return v;
+}
+
+struct Symbol {
+	double value;
+	bool defined;
+};
+
+inline double Get(const Symbol &s, const char *missing) {
+	if (!s.defined)
+		Raise(missing);
+	return s.value;
+}
+
+inline void Set(Symbol &s, double v) {
+	s.value = v;
+	s.defined = true;
+}
+
+// A literal without an exact decimal form: infinities and NaNs.
+inline double Bits(uint64_t bits) {
+	double v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+typedef void (*Directive)();
+
+inline void Call(Directive d, const char *missing) {
+	if (d == nullptr)
+		Raise(missing);
+	d();
+}
+)";
+
+static const char *sScriptRuntime = R"(
+// Prints and empties the stack after a line, as ast_yet does.
+void Print() {
+	while (!S.empty()) {
+		cout << S.back() << endl;
+		S.pop_back();
+	}
+}
+)";
+
+static const char *sTestRuntime = R"(
+typedef chrono::steady_clock Clock;
+
+struct Counts {
+	int ok = 0, miss = 0, error = 0;
+};
+
+typedef enum {
+	VALUE_EXPECTED,
+	ERROR_EXPECTED,
+	NOTHING_EXPECTED,
+	MALFORMED_CASE,
+	UNPARSABLE_CASE,
+} Expectation;
+
+// TestCase of ast.cpp, with the input run by `run`.
+void Case(void (*run)(), const char *input, const char *output, const char *postfix, Expectation expect,
+		  double o, int line, ostream &out, Counts &counts) {
+	bool unexpected = expect != ERROR_EXPECTED;
+
+	try {
+		double r = NAN;
+		bool nan;
+
+		if (expect == MALFORMED_CASE)
+			Raise("wrong test suite syntax");
+		if (run != nullptr)
+			run();
+		if (!S.empty())
+			r = Pop();
+		if (expect == UNPARSABLE_CASE)
+			Raise("wrong test suite syntax");
+
+		if (expect == VALUE_EXPECTED && (((nan = isnan(o)) && isnan(r)) || (!nan && (r == o || to_string(r) == to_string(o))))) {
+			counts.ok++;
+		} else if (expect != NOTHING_EXPECTED) {
+			out << "MIS [" << input << "] => ops[" << postfix << "] (gets " << output << ",  return " << r << ") on line " << line << endl;
+			counts.miss++;
+		} else {
+			counts.ok++;
+		}
+	} catch (const ASTError &ex) {
+		if (unexpected) {
+			out << "ERR [" << input << "] => err[" << ex.what() << "] on line " << line << endl;
+			counts.error++;
+		} else {
+			counts.ok++;
+		}
+	}
+}
+)";
+
+void ASTTranspiler::Write(ostream &out) {
+	static const char *builtins[] = { "_1", "_2", "_3", "_4" };
+	static const char *comparisons[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+	mFunctions.str("");
+	mMain.str("");
+	mSymbols.clear();
+	mSlots.clear();
+	mSymbolIndex.clear();
+	mSlotIndex.clear();
+	mGuards.clear();
+	mGuardIndex.clear();
+	mDefinitions.clear();
+	mUnits = 0;
+	mCompare = false;
+
+	for (const ASTEmitFile &f : mFiles) {
+		if (mTests)
+			mMain << "\t{\n\t\tClock::time_point begin = Clock::now();\n\t\tCounts counts;\n\t\tostringstream out;\n\n";
+
+		for (const ASTEmitShard &shard : f.shards)
+			WriteShard(shard);
+
+		if (mTests) {
+			mMain << "\n\t\tcout << " << Quote("FILE " + f.path + ": OK ") << " << counts.ok << \", MIS \" << counts.miss << \", ERR \" << counts.error\n"
+				  << "\t\t\t << \" in \" << chrono::duration<double>(Clock::now() - begin).count() * 1e3 << \" ms\" << endl;\n"
+				  << "\t\tcout << out.str();\n"
+				  << "\t\ttotal.ok += counts.ok;\n\t\ttotal.miss += counts.miss;\n\t\ttotal.error += counts.error;\n\t}\n";
+		}
+	}
+
+	// read by the builtins, whether or not the script names them
+	if (mCompare) {
+		for (const char *b : builtins)
+			Symbol(ASTNameTable::Intern(b));
+	}
+
+	out << "// Generated by ast_yet -emit-cpp from";
+	for (const ASTEmitFile &f : mFiles)
+		out << " " << f.path;
+	out << ".\n// Arithmetic must stay IEEE, build without -ffast-math.\n";
+	if (mTests)
+		out << "#include <chrono>\n#include <sstream>\n";
+	out << sPrelude << (mTests ? sTestRuntime : sScriptRuntime) << "\n";
+
+	for (size_t i = 0; i < mSymbols.size(); i++)
+		out << "Symbol s" << i << "; // " << ASTNameTable::GetName(mSymbols[i]) << "\n";
+	out << "\n";
+
+	for (size_t i = 0; i < mGuards.size(); i++)
+		out << "bool e" << i << " = false; // " << mGuards[i] << "\n";
+	if (!mGuards.empty())
+		out << "\n";
+
+	for (size_t i = 0; i < mSlots.size(); i++) {
+		const unsigned name = mSlots[i];
+
+		// `_` and `__` cannot be called until defined
+		if (name == ASTNameTable::STACK_TOP_NAME || name == ASTNameTable::STACK_SIZE_NAME) {
+			out << "void n" << i << "() {\n\tRaise(" << Quote("cannot call null directive " + ASTNameTable::GetName(name)) << ");\n}\n\n"
+				<< "Directive c" << i << " = n" << i << "; // " << ASTNameTable::GetName(name) << "\n\n";
+		} else {
+			out << "Directive c" << i << " = nullptr; // " << ASTNameTable::GetName(name) << "\n\n";
+		}
+	}
+
+	// CallBuiltin of the interpreter
+	if (mCompare) {
+		out << "void Compare(int op) {\n"
+			<< "\tSymbol &a = " << Symbol(ASTNameTable::Intern(builtins[0])) << ", &b = " << Symbol(ASTNameTable::Intern(builtins[1]))
+			<< ", &t = " << Symbol(ASTNameTable::Intern(builtins[2])) << ", &f = " << Symbol(ASTNameTable::Intern(builtins[3])) << ";\n"
+			<< "\tbool r = false;\n\n"
+			<< "\tif (!a.defined || !b.defined || !t.defined || !f.defined)\n"
+			<< "\t\tRaise(\"directive required symbols do not exists\");\n\n"
+			<< "\tswitch (op) {\n";
+		for (size_t i = 0; i < sizeof(comparisons) / sizeof(comparisons[0]); i++)
+			out << "\tcase " << i << ":\n\t\tr = a.value " << comparisons[i] << " b.value;\n\t\tbreak;\n";
+		out << "\t}\n\n\tSet(a, r ? t.value : f.value);\n}\n\n";
+	}
+
+	// a fresh interpreter, for every shard of a test file
+	if (mTests) {
+		out << "void Reset() {\n\tS.clear();\n";
+		for (size_t i = 0; i < mSymbols.size(); i++)
+			out << "\ts" << i << " = Symbol();\n";
+		for (size_t i = 0; i < mSlots.size(); i++)
+			out << "\tc" << i << " = " << (mSlots[i] == ASTNameTable::STACK_TOP_NAME || mSlots[i] == ASTNameTable::STACK_SIZE_NAME ? "n" + to_string(i) : "nullptr") << ";\n";
+		for (size_t i = 0; i < mGuards.size(); i++)
+			out << "\te" << i << " = false;\n";
+		out << "}\n\n";
+	}
+
+	out << mFunctions.str() << "}\n\n";
+
+	out << "int ASTRunEmitted() {\n";
+	if (mTests) {
+		out << "\tCounts total;\n\n" << mMain.str()
+			<< "\n\tcout << \"COUNT---\" << endl;\n"
+			<< "\tcout << \"OK: \" << total.ok << endl;\n"
+			<< "\tcout << \"MIS: \" << total.miss << endl;\n"
+			<< "\tcout << \"ERR: \" << total.error << endl;\n\n"
+			<< "\treturn total.miss == 0 && total.error == 0 ? 0 : 1;\n";
+	} else {
+		out << "\tint line = 0;\n\n\ttry {\n" << mMain.str()
+			<< "\t} catch (const ASTError &ex) {\n"
+			<< "\t\tcout << \"Error on line \" << line << \": \" << ex.what() << endl;\n"
+			<< "\t}\n\n\treturn 0;\n";
+	}
+	out << "}\n\n#ifndef AST_EMITTED_NO_MAIN\nint main() {\n\treturn ASTRunEmitted();\n}\n#endif\n";
+}
+
+void ASTTranspiler::WriteShard(const ASTEmitShard &shard) {
+	mShard = &shard;
+	mCurrent.clear();
+	mPosition = 0;
+
+	if (mTests)
+		mMain << "\t\tReset();\n";
+
+	for (const ASTEmitUnit &unit : shard.units) {
+		long u = WriteUnit(unit);
+		string run = u < 0 ? "nullptr" : "u" + to_string(u);
+
+		if (mTests) {
+			mMain << "\t\tCase(" << run << ", " << Quote(unit.input) << ", " << Quote(unit.output) << ", " << Quote(unit.postfix) << ", ";
+			switch (unit.expect) {
+			case VALUE_EXPECTED:
+				mMain << "VALUE_EXPECTED";
+				break;
+			case ERROR_EXPECTED:
+				mMain << "ERROR_EXPECTED";
+				break;
+			case MALFORMED_CASE:
+				mMain << "MALFORMED_CASE";
+				break;
+			case UNPARSABLE_CASE:
+				mMain << "UNPARSABLE_CASE";
+				break;
+			default:
+				mMain << "NOTHING_EXPECTED";
+				break;
+			}
+			mMain << ", " << Number(unit.expected) << ", " << unit.line << ", out, counts);\n";
+		} else if (u >= 0) {
+			// the stack is empty again after every line, nothing to print
+			mMain << "\t\tline = " << unit.line << ";\n\t\t" << run << "();\n\t\tPrint();\n";
+		}
+	}
+}
+
+long ASTTranspiler::WriteUnit(const ASTEmitUnit &unit) {
+	ostringstream body;
+	bool certain = true;
+
+	WriteEntries(body, "\t", unit.entries, true, certain);
+	if (body.str().empty())
+		return -1;
+
+	mFunctions << "// line " << unit.line << "\nvoid u" << mUnits << "() {\n" << body.str() << "}\n\n";
+	return mUnits++;
+}
+
+bool ASTTranspiler::WriteEntries(ostream &out, const string &indent, const vector<ASTEmitEntry> &entries, bool top, bool &certain) {
+	const string inner = indent + "\t";
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		const ASTEmitEntry &entry = entries[i];
+		// a script line starts on an empty stack, a test case on what the
+		// one before left; the lines of an include run on what is there
+		const long height = !mTests && top && i == 0 ? 0 : -1;
+
+		if (!entry.error.empty()) {
+			out << indent << "Raise(" << Quote(entry.error) << ");\n";
+			return false;
+		}
+
+		switch (entry.type) {
+		case ASTLine::EXPRESSION_LINE:
+			out << indent << "{\n";
+			WriteProgram(out, inner.c_str(), entry.program, nullptr, height, false, false);
+			out << indent << "}\n";
+			certain = false;
+			break;
+		case ASTLine::SYMBOL_SET_LINE: {
+			const string &key = entry.key;
+
+			out << indent << "{\n";
+			WriteProgram(out, inner.c_str(), entry.program, nullptr, height, false, true);
+			if (!entry.program.returns)
+				out << inner << "v0 = Pop();\n";
+
+			if (!OperandEntity::IsValid(key)) {
+				out << inner << "(void)v0;\n" << inner << "Raise(\"invalid symbol name\");\n";
+			} else {
+				unsigned id = ASTNameTable::Intern(key);
+
+				if (id == ASTNameTable::STACK_TOP_NAME)
+					out << inner << "Push(v0);\n";
+				else if (id == ASTNameTable::STACK_SIZE_NAME)
+					out << inner << "(void)v0;\n" << inner << "Raise(\"assignment to a reserved symbol\");\n";
+				else
+					out << inner << "Set(" << Symbol(id) << ", v0);\n";
+			}
+			out << indent << "}\n";
+			certain = false;
+			break;
+		}
+		case ASTLine::DIRECTIVE_SET_LINE: {
+			const ASTEmitDefinition *d = WriteDefinition(entry);
+
+			out << indent << Slot(d->name) << " = g" << d->index << ";\n";
+			mCurrent[d->name] = certain ? d : nullptr;
+			break;
+		}
+		case ASTLine::DIRECTIVE_CALL_LINE: {
+			unsigned id = ASTNameTable::Intern(entry.key);
+
+			out << indent;
+			WriteCall(out, Resolve(id, nullptr), id);
+			certain = false;
+			break;
+		}
+		case ASTLine::INCLUDE_LINE:
+			out << indent << Guard(entry.path) << " = true;\n";
+			if (!WriteEntries(out, indent, entry.included, false, certain))
+				return false;
+			break;
+		case ASTLine::INCLUDE_ONCE_LINE: {
+			const string guard = Guard(entry.path);
+
+			// whether it runs is only known then; when it always fails, what
+			// follows still runs whenever it is skipped
+			out << indent << "if (!" << guard << ") {\n" << inner << guard << " = true;\n";
+			certain = false;
+			WriteEntries(out, inner, entry.included, false, certain);
+			out << indent << "}\n";
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+// Writes the directive a set defines. Its callees are only known ahead when
+// they are set once in the shard, before it.
+const ASTEmitDefinition* ASTTranspiler::WriteDefinition(const ASTEmitEntry &entry) {
+	ASTEmitDefinition *d = new ASTEmitDefinition();
+	const ASTProgram &p = entry.program;
+	const string name = entry.key;
+
+	mDefinitions.emplace_back(d);
+	d->name = ASTNameTable::Intern(name);
+	d->index = mDefinitions.size() - 1;
+	d->position = mPosition++;
+	d->entry = &entry;
+
+	if (entry.empty) {
+		mFunctions << "// " << name << "\nvoid g" << d->index << "() {\n\tRaise("
+				   << Quote("cannot call null directive " + name) << ");\n}\n\n";
+		return d;
+	}
+
+	d->parametric = p.returns && !p.effects.reads_stack_size;
+
+	for (const ASTInstruction &i : p.code) {
+		switch (i.op) {
+		case ASTInstruction::LOAD_SYMBOL:
+			if (i.name != ASTNameTable::STACK_TOP_NAME && i.name != ASTNameTable::STACK_SIZE_NAME)
+				d->fallible = true;
+			break;
+		case ASTInstruction::STORE_SYMBOL:
+			if (i.name == ASTNameTable::STACK_TOP_NAME || i.name == ASTNameTable::STACK_SIZE_NAME)
+				d->parametric = false;
+			break;
+		case ASTInstruction::CALL_DIRECTIVE: {
+			ASTEmitTarget t = Resolve(i.name, d);
+
+			if (t.type == ASTEmitTarget::DEFINITION_TARGET && t.definition->parametric &&
+				t.definition->entry->program.effects.pops == i.argc) {
+				d->fallible = d->fallible || t.definition->fallible;
+			} else {
+				d->parametric = false;
+				d->fallible = true;
+			}
+			break;
+		}
+		case ASTInstruction::RAISE_VALUE_ERROR:
+		case ASTInstruction::RAISE_TYPE_ERROR:
+		case ASTInstruction::RAISE_INVALID_OPERATION:
+			d->fallible = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// a failing case leaves the arguments not popped yet for the next one
+	if (mTests && d->fallible)
+		d->parametric = false;
+
+	mFunctions << "// " << name << "\nvoid g" << d->index << "() {\n";
+	WriteProgram(mFunctions, "\t", p, d, -1, false, false);
+	mFunctions << "}\n\n";
+
+	if (d->parametric) {
+		mFunctions << "inline double p" << d->index << "(";
+		for (unsigned a = 0; a < p.effects.pops; a++)
+			mFunctions << (a > 0 ? ", " : "") << "double a" << a;
+		mFunctions << ") {\n";
+		WriteProgram(mFunctions, "\t", p, d, -1, true, false);
+		mFunctions << "}\n\n";
+	}
+
+	return d;
+}
+
+// Writes `p` as Execute runs it, over one variable per operand depth. The
+// stack is `height` deep where known, -1 otherwise; `parametric` takes `_`
+// from the parameters and returns the value, `leave` keeps it in v0.
+void ASTTranspiler::WriteProgram(ostream &out, const char *indent, const ASTProgram &p, const ASTEmitDefinition *owner,
+	long height, bool parametric, bool leave) {
+	ostringstream code;
+	// variables are only declared as far as they are used, `leave` needs v0
+	size_t depth = 0, reached = leave ? 1 : 0, locals = 0;
+	unsigned popped = 0;
+	bool raised = false;
+
+	for (const ASTInstruction &i : p.code) {
+		if (raised)
+			break;
+
+		switch (i.op) {
+		case ASTInstruction::PUSH_LITERAL:
+			code << indent << "v" << depth++ << " = " << Number(i.value) << ";\n";
+			break;
+		case ASTInstruction::LOAD_SYMBOL: {
+			string load;
+
+			if (i.name == ASTNameTable::STACK_TOP_NAME) {
+				if (parametric) {
+					load = "a" + to_string(popped++);
+				} else {
+					load = "Pop()";
+					height = height > 0 ? height - 1 : -1;
+				}
+			} else if (i.name == ASTNameTable::STACK_SIZE_NAME) {
+				load = height >= 0 ? Number(height) : "(double)S.size()";
+			} else {
+				load = "Get(" + Symbol(i.name) + ", " + Quote("cannot find symbol " + ASTNameTable::GetName(i.name)) + ")";
+			}
+
+			code << indent << "v" << depth++ << " = " << (i.negative ? "-" : "") << load << ";\n";
+			break;
+		}
+		case ASTInstruction::STORE_SYMBOL:
+			if (i.name == ASTNameTable::STACK_TOP_NAME) {
+				code << indent << "Push(v" << depth - 1 << ");\n";
+				if (height >= 0)
+					height++;
+			} else if (i.name == ASTNameTable::STACK_SIZE_NAME) {
+				code << indent << "Raise(\"assignment to a reserved symbol\");\n";
+			} else {
+				code << indent << "Set(" << Symbol(i.name) << ", v" << depth - 1 << ");\n";
+			}
+			break;
+		case ASTInstruction::ARITHMETIC_ADD:
+		case ASTInstruction::ARITHMETIC_SUB:
+		case ASTInstruction::ARITHMETIC_MUL:
+		case ASTInstruction::ARITHMETIC_DIV: {
+			static const char *ops[] = { " + ", " - ", " * ", " / " };
+
+			code << indent << "v" << depth - 2 << " = v" << depth - 2 << ops[i.op - ASTInstruction::ARITHMETIC_ADD]
+				<< "v" << depth - 1 << ";\n";
+			depth--;
+			break;
+		}
+		case ASTInstruction::ARITHMETIC_MOD:
+		case ASTInstruction::ARITHMETIC_POW:
+			code << indent << "v" << depth - 2 << " = " << (i.op == ASTInstruction::ARITHMETIC_MOD ? "fmod" : "pow")
+				<< "(v" << depth - 2 << ", v" << depth - 1 << ");\n";
+			depth--;
+			break;
+		case ASTInstruction::NEGATE:
+			code << indent << "v" << depth - 1 << " = -v" << depth - 1 << ";\n";
+			break;
+		case ASTInstruction::CALL_DIRECTIVE: {
+			ASTEmitTarget t = Resolve(i.name, owner);
+			const size_t first = depth - i.argc;
+
+			if (t.type == ASTEmitTarget::DEFINITION_TARGET && t.definition->parametric &&
+				t.definition->entry->program.effects.pops == i.argc) {
+				string call = string(i.negative ? "-" : "") + "p" + to_string(t.definition->index) + "(";
+
+				for (size_t a = first; a < depth; a++)
+					call += (a > first ? ", v" : "v") + to_string(a);
+				call += ")";
+
+				if (i.keep) {
+					code << indent << "Push(" << call << ");\n";
+					if (height >= 0)
+						height++;
+				} else {
+					code << indent << "v" << first << " = " << call << ";\n";
+				}
+			} else {
+				// the first argument ends up on top
+				for (size_t a = depth; a > first; a--)
+					code << indent << "Push(v" << a - 1 << ");\n";
+				code << indent;
+				WriteCall(code, t, i.name);
+				if (i.negative)
+					code << indent << "Push(-Pop());\n";
+				if (!i.keep)
+					code << indent << "v" << first << " = Pop();\n";
+				height = -1;
+			}
+
+			depth = first + (i.keep ? 0 : 1);
+			break;
+		}
+		case ASTInstruction::STORE_LOCAL:
+			locals = max(locals, (size_t)i.name + 1);
+			code << indent << "l" << i.name << " = v" << depth - 1 << ";\n";
+			break;
+		case ASTInstruction::LOAD_LOCAL:
+			code << indent << "v" << depth++ << " = l" << i.name << ";\n";
+			break;
+		case ASTInstruction::RETURN_VALUE:
+			depth--;
+			if (parametric)
+				code << indent << "return v" << depth << ";\n";
+			else if (!leave)
+				code << indent << "Push(v" << depth << ");\n";
+			break;
+		case ASTInstruction::RAISE_VALUE_ERROR:
+		case ASTInstruction::RAISE_TYPE_ERROR:
+		case ASTInstruction::RAISE_INVALID_OPERATION:
+		default:
+			// what follows never runs, and pops nothing it pushed
+			for (size_t k = 0; k < depth; k++)
+				code << indent << "(void)v" << k << ";\n";
+			for (size_t k = 0; k < locals; k++)
+				code << indent << "(void)l" << k << ";\n";
+			code << indent << "Raise(" << Quote(p.names[i.name]) << ");\n";
+			raised = true;
+			break;
+		}
+
+		reached = max(reached, depth);
+	}
+
+	// the parameters a raise came before
+	for (unsigned a = popped; parametric && a < p.effects.pops; a++)
+		code << indent << "(void)a" << a << ";\n";
+
+	if (reached > 0 || locals > 0) {
+		const char *separator = "";
+
+		out << indent << "double ";
+		for (size_t k = 0; k < reached; k++, separator = ", ")
+			out << separator << "v" << k;
+		for (size_t k = 0; k < locals; k++, separator = ", ")
+			out << separator << "l" << k;
+		out << ";\n\n";
+	}
+	out << code.str();
+}
+
+void ASTTranspiler::WriteCall(ostream &out, const ASTEmitTarget &target, unsigned name) {
+	switch (target.type) {
+	case ASTEmitTarget::DEFINITION_TARGET:
+		out << "g" << target.definition->index << "();\n";
+		break;
+	case ASTEmitTarget::BUILTIN_TARGET:
+		mCompare = true;
+		out << "Compare(" << target.builtin - ASTCallSite::CMP_EQ_BUILTIN << ");\n";
+		break;
+	case ASTEmitTarget::NULL_TARGET:
+		out << "Raise(" << Quote("cannot call null directive " + ASTNameTable::GetName(name)) << ");\n";
+		break;
+	case ASTEmitTarget::MISSING_TARGET:
+		out << "Raise(" << Quote("cannot find directive " + ASTNameTable::GetName(name)) << ");\n";
+		break;
+	case ASTEmitTarget::SLOT_TARGET:
+	default:
+		out << "Call(" << Slot(name) << ", " << Quote("cannot find directive " + ASTNameTable::GetName(name)) << ");\n";
+		break;
+	}
+}
+
+// What a call of `name` reaches, from a line of the shard being written or
+// from the body of `owner`.
+ASTEmitTarget ASTTranspiler::Resolve(unsigned name, const ASTEmitDefinition *owner) {
+	ASTEmitTarget t;
+
+	t.builtin = ASTCallSite::GetBuiltin(name);
+	if (t.builtin != ASTCallSite::NO_BUILTIN) {
+		t.type = ASTEmitTarget::BUILTIN_TARGET;
+		return t;
+	}
+
+	unordered_map<unsigned, const ASTEmitDefinition*>::iterator current = mCurrent.find(name);
+	unordered_map<unsigned, size_t>::const_iterator sets = mShard->definitions.find(name);
+
+	if (owner == nullptr && current != mCurrent.end()) {
+		// a line runs after exactly the sets before it, if they surely ran
+		t.type = current->second != nullptr ? ASTEmitTarget::DEFINITION_TARGET : ASTEmitTarget::SLOT_TARGET;
+		t.definition = current->second;
+	} else if (owner != nullptr && sets != mShard->definitions.end()) {
+		// a body runs after its own set; only one that surely ran before it is certain
+		if (sets->second == 1 && current != mCurrent.end() && current->second != nullptr &&
+			current->second->position < owner->position) {
+			t.type = ASTEmitTarget::DEFINITION_TARGET;
+			t.definition = current->second;
+		} else {
+			t.type = ASTEmitTarget::SLOT_TARGET;
+		}
+	} else if (name == ASTNameTable::STACK_TOP_NAME || name == ASTNameTable::STACK_SIZE_NAME) {
+		t.type = ASTEmitTarget::NULL_TARGET;
+	} else {
+		t.type = ASTEmitTarget::MISSING_TARGET;
+	}
+
+	return t;
+}
+
+string ASTTranspiler::Symbol(unsigned name) {
+	unordered_map<unsigned, size_t>::iterator it = mSymbolIndex.find(name);
+
+	if (it == mSymbolIndex.end()) {
+		it = mSymbolIndex.emplace(name, mSymbols.size()).first;
+		mSymbols.push_back(name);
+	}
+
+	return "s" + to_string(it->second);
+}
+
+string ASTTranspiler::Slot(unsigned name) {
+	unordered_map<unsigned, size_t>::iterator it = mSlotIndex.find(name);
+
+	if (it == mSlotIndex.end()) {
+		it = mSlotIndex.emplace(name, mSlots.size()).first;
+		mSlots.push_back(name);
+	}
+
+	return "c" + to_string(it->second);
+}
+
+string ASTTranspiler::Guard(const string &path) {
+	unordered_map<string, size_t>::iterator it = mGuardIndex.find(path);
+
+	if (it == mGuardIndex.end()) {
+		it = mGuardIndex.emplace(path, mGuards.size()).first;
+		mGuards.push_back(path);
+	}
+
+	return "e" + to_string(it->second);
+}
+
+// A C++ string literal of `s`.
+string ASTTranspiler::Quote(const string &s) {
+	string r("\"");
+
+	for (unsigned char c : s) {
+		if (c == '"' || c == '\\') {
+			r += '\\';
+			r += c;
+		} else if (c == '?') {
+			// never part of a trigraph
+			r += "\\?";
+		} else if (c >= 0x20 && c < 0x7F) {
+			r += c;
+		} else {
+			char octal[8];
+			snprintf(octal, sizeof(octal), "\\%03o", c);
+			r += octal;
+		}
+	}
+
+	return r + "\"";
+}
+
+// A double literal of exactly `v`.
+string ASTTranspiler::Number(double v) {
+	char buffer[32];
+
+	if (!isfinite(v)) {
+		uint64_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		snprintf(buffer, sizeof(buffer), "Bits(0x%016llxULL)", (unsigned long long)bits);
+		return buffer;
+	}
+
+	// 17 digits always read back to the same double
+	snprintf(buffer, sizeof(buffer), "%.17g", v);
+	string r(buffer);
+	if (r.find_first_of(".e") == string::npos)
+		r += ".0";
+	return r;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "classifier.hpp"
+#include "compiler.hpp"
+#include "include.hpp"
+#include "lexical.hpp"
+#include "optimizer.hpp"
+
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// One line as it would run, compiled ahead; an include holds the lines of
+// the file it runs.
+struct ASTEmitEntry {
+	ASTLine::LineType type;
+	string key;
+	// the file of an include, as the include cache keys it
+	string path;
+	vector<ASTEmitEntry> included;
+	// the program of an expression, a symbol set or a directive body
+	ASTProgram program;
+	// a directive set with nothing after the name
+	bool empty = false;
+	// what running the line throws before anything else, if anything
+	string error;
+};
+
+// What a test case expects, see TestCase in ast.cpp.
+typedef enum {
+	VALUE_EXPECTED,
+	ERROR_EXPECTED,
+	NOTHING_EXPECTED,
+	// no output column: fails before the input runs
+	MALFORMED_CASE,
+	// an output that is not a number: fails after the input ran
+	UNPARSABLE_CASE,
+} ASTEmitExpectation;
+
+// A line of a script, or a test case with its expectation.
+struct ASTEmitUnit {
+	int line;
+	vector<ASTEmitEntry> entries;
+	string input, output, postfix;
+	ASTEmitExpectation expect = NOTHING_EXPECTED;
+	double expected = 0;
+};
+
+// Units that run on one fresh interpreter: a whole script, or the cases of
+// a test file between reset markers.
+struct ASTEmitShard {
+	vector<ASTEmitUnit> units;
+	// successful directive sets, by interned name
+	unordered_map<unsigned, size_t> definitions;
+};
+
+struct ASTEmitFile {
+	string path;
+	vector<ASTEmitShard> shards;
+};
+
+// A directive set as emitted: a function running the body on the stack
+// and, when `parametric`, an inline one taking its `pops` arguments as
+// parameters and returning its value.
+struct ASTEmitDefinition {
+	unsigned name;
+	size_t index;
+	// the order of the set within its shard
+	size_t position;
+	const ASTEmitEntry *entry;
+	bool parametric = false;
+	// may throw, and so leave a value pushed halfway in the VM
+	bool fallible = false;
+};
+
+// Where a call goes, as far as it is known ahead.
+struct ASTEmitTarget {
+	typedef enum {
+		DEFINITION_TARGET,
+		BUILTIN_TARGET,
+		// `_` and `__` when nothing is defined under them
+		NULL_TARGET,
+		MISSING_TARGET,
+		// through the name's slot, set by whichever set ran last
+		SLOT_TARGET,
+	} Type;
+
+	Type type;
+	const ASTEmitDefinition *definition = nullptr;
+	ASTCallSite::BuiltinType builtin = ASTCallSite::NO_BUILTIN;
+};
+
+// Translates scripts, or test files, into one standalone C++ translation
+// unit behaving as the interpreter would on them: every line is parsed,
+// optimized and compiled as ASTInterpreter does, and each ASTProgram is
+// written out as straight-line C++ over named doubles.
+//
+// Directive sets become functions and the slot of their name a function
+// pointer. A call goes straight to the definition whenever only one can be
+// current there, and passes its arguments as parameters when the body pops
+// exactly them and never otherwise touches the stack; a script stops at
+// its first error, in a test file that also needs a body that cannot fail.
+// `__` is a constant where a script line's stack is known to be empty.
+class ASTTranspiler : public ASTLex {
+public:
+	ASTTranspiler();
+	// A script, run as RunScript in ast.cpp runs it. False when it cannot be read.
+	bool AddScript(const string &path);
+	// A test file, checked as TestFiles in ast.cpp checks it. False when it
+	// cannot be read.
+	bool AddTests(const string &path);
+	// Applies only to what is added afterwards, as in ASTInterpreter.
+	void SetOptimize(bool optimize);
+	bool GetOptimize();
+	// The whole translation unit. It runs everything added from main, or
+	// from ASTRunEmitted when built with AST_EMITTED_NO_MAIN; a test build
+	// fails when a case does.
+	void Write(ostream &out);
+protected:
+	bool mOptimize = true;
+	bool mTests = false;
+	ASTOptimizer mOptimizer;
+	ASTCompiler mCompiler;
+	vector<ASTEmitFile> mFiles;
+	// the files being included, innermost last
+	vector<string> mIncluding;
+
+	// filled in by Write
+	ostringstream mFunctions, mMain;
+	vector<unsigned> mSymbols, mSlots;
+	unordered_map<unsigned, size_t> mSymbolIndex, mSlotIndex;
+	// whether a file was included yet, by path
+	vector<string> mGuards;
+	unordered_map<string, size_t> mGuardIndex;
+	vector<unique_ptr<ASTEmitDefinition>> mDefinitions;
+	const ASTEmitShard *mShard = nullptr;
+	// by interned name, the set that last ran in the shard being written;
+	// nullptr when a set under it may or may not have run
+	unordered_map<unsigned, const ASTEmitDefinition*> mCurrent;
+	size_t mPosition = 0, mUnits = 0;
+	// whether any call reaches a builtin comparison
+	bool mCompare = false;
+
+	// -- pass 1, as lines are added
+	void Expand(const char *s, size_t n, vector<ASTEmitEntry> &entries, ASTEmitShard &shard, string *postfix=nullptr);
+	void CompileInto(Entity *e, ASTEmitEntry &entry);
+	void AddCase(const string &input, int line, ASTEmitShard &shard);
+
+	// -- pass 2, in Write
+	void WriteShard(const ASTEmitShard &shard);
+	// the index of the unit's function, or -1 when it runs nothing
+	long WriteUnit(const ASTEmitUnit &unit);
+	// False once an entry always fails, nothing after it runs. `certain`
+	// says whether the entries run for sure, and turns false at one that may fail.
+	bool WriteEntries(ostream &out, const string &indent, const vector<ASTEmitEntry> &entries, bool top, bool &certain);
+	const ASTEmitDefinition* WriteDefinition(const ASTEmitEntry &entry);
+	void WriteProgram(ostream &out, const char *indent, const ASTProgram &p, const ASTEmitDefinition *owner,
+		long height, bool parametric, bool leave);
+	void WriteCall(ostream &out, const ASTEmitTarget &target, unsigned name);
+	ASTEmitTarget Resolve(unsigned name, const ASTEmitDefinition *owner);
+	string Symbol(unsigned name);
+	string Slot(unsigned name);
+	string Guard(const string &path);
+
+	static string Quote(const string &s);
+	static string Number(double v);
+};